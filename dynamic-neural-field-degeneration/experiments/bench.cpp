@@ -0,0 +1,486 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "degenerate_field_coupling.h"
+#include "degenerate_neural_field.h"
+#include "dnf_architecture.h"
+#include "elements/gauss_stimulus.h"
+
+// Micro-benchmarks of the hot loops of the experiment. Each one times the current implementation against
+// the loop it replaced, reproduced here as it was. Runs every benchmark, or the ones named on the command line.
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	constexpr int perceptualFieldSize = 720; // 360 / 0.5
+	constexpr int outputFieldSize = 280; // 28 / 0.1
+
+	constexpr double perceptualStepSize = 0.5;
+	constexpr double outputStepSize = 0.1;
+
+	volatile double sink; // keeps the results of the timed calls alive
+
+	// Median time of one call in microseconds, over batches of calls long enough for the clock.
+	template<typename Function>
+	double measure(Function&& function, int callsPerBatch, int numberOfBatches = 15)
+	{
+		std::vector<double> times;
+		for (int batch = 0; batch < numberOfBatches; batch++)
+		{
+			const auto start = Clock::now();
+			for (int call = 0; call < callsPerBatch; call++)
+				function();
+			times.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count() / callsPerBatch);
+		}
+		std::nth_element(times.begin(), times.begin() + numberOfBatches / 2, times.end());
+		return times[numberOfBatches / 2];
+	}
+
+	std::vector<double> getUniformValues(int size, double min, double max, std::mt19937_64& generator)
+	{
+		std::uniform_real_distribution<double> distribution(min, max);
+		std::vector<double> values(size);
+		for (double& value : values)
+			value = distribution(generator);
+		return values;
+	}
+
+	// DegenerateNeuralField::calculateActivation before the alive mask: every neuron searched the dead ones.
+	void stepWithDeadIndices(double* activation, const double* restingLevel, const double* input, int size,
+		const std::vector<int>& deadIndices, double rate)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			if (std::find(deadIndices.begin(), deadIndices.end(), i) != deadIndices.end())
+				activation[i] = 0;
+			else
+				activation[i] = activation[i] + rate * (-activation[i] + restingLevel[i] + input[i]);
+		}
+	}
+
+	// The loop of DegenerateNeuralField::calculateActivation.
+	void stepWithAliveMask(double* __restrict activation, const double* __restrict restingLevel, const double* __restrict input,
+		int size, const double* __restrict mask, double rate)
+	{
+		for (int i = 0; i < size; i++)
+			activation[i] = (activation[i] + rate * (-activation[i] + restingLevel[i] + input[i])) * mask[i];
+	}
+
+	void benchmarkDeadNeurons()
+	{
+		std::cout << "Euler step of the perceptual field (" << perceptualFieldSize << " neurons), us per step\n"
+			<< std::setw(14) << "dead neurons" << std::setw(14) << "find" << std::setw(14) << "alive mask" << '\n';
+
+		std::mt19937_64 generator(1);
+		const std::vector<double> restingLevel(perceptualFieldSize, -5.0);
+		const std::vector<double> input = getUniformValues(perceptualFieldSize, -1.0, 1.0, generator);
+		std::vector<int> order(perceptualFieldSize);
+		std::iota(order.begin(), order.end(), 0);
+		std::shuffle(order.begin(), order.end(), generator);
+
+		for (const double fraction : { 0.0, 0.14, 0.5 })
+		{
+			const int numberOfDead = static_cast<int>(fraction * perceptualFieldSize);
+			const std::vector<int> deadIndices(order.begin(), order.begin() + numberOfDead);
+			std::vector<double> mask(perceptualFieldSize, 1.0);
+			for (const int index : deadIndices)
+				mask[index] = 0.0;
+
+			std::vector<double> activation(perceptualFieldSize, -5.0);
+			const double find = measure([&] {
+				stepWithDeadIndices(activation.data(), restingLevel.data(), input.data(), perceptualFieldSize, deadIndices, 0.04);
+				sink = activation[0];
+			}, 200);
+			const double masked = measure([&] {
+				stepWithAliveMask(activation.data(), restingLevel.data(), input.data(), perceptualFieldSize, mask.data(), 0.04);
+				sink = activation[0];
+			}, 20000);
+
+			std::cout << std::setw(14) << numberOfDead << std::fixed << std::setprecision(3)
+				<< std::setw(14) << find << std::setw(14) << masked << '\n';
+		}
+		std::cout << std::endl;
+	}
+
+	// Exposes the FieldCoupling flag that decides whether the learning rule leaves degenerated weights untouched.
+	class RelearningCoupling : public DegenerateFieldCoupling
+	{
+	public:
+		using DegenerateFieldCoupling::DegenerateFieldCoupling;
+
+		void setUpdateAllWeights(bool updateAllWeights) { this->updateAllWeights = updateAllWeights; }
+	};
+
+	std::vector<double> getGaussian(int size, double stepSize, double position, double width)
+	{
+		std::vector<double> values(size);
+		for (int i = 0; i < size; i++)
+		{
+			const double distance = i * stepSize - position;
+			values[i] = std::exp(-0.5 * distance * distance / (width * width));
+		}
+		return values;
+	}
+
+	// DegenerateFieldCoupling::learningRuleDegenerate before it worked in place, updating all weights: the
+	// scratch vectors were allocated per call and the weights returned by value and assigned back.
+	std::vector<std::vector<double>> learningRuleByValue(std::vector<std::vector<double>>& weights,
+		const std::vector<double>& input, const std::vector<double>& targetOutput, const double& learningRate)
+	{
+		const double eta = 0.5;
+		const size_t inputSize = input.size();
+		const size_t outputSize = targetOutput.size();
+
+		std::vector<double> actualOutput(outputSize, 0.0);
+		for (size_t j = 0; j < outputSize; ++j)
+			for (size_t i = 0; i < inputSize; ++i)
+				actualOutput[j] += input[i] * weights[i][j];
+
+		std::vector<double> error(outputSize, 0.0);
+		for (size_t j = 0; j < outputSize; ++j)
+			error[j] = targetOutput[j] - actualOutput[j];
+
+		for (size_t i = 0; i < inputSize; ++i)
+			for (size_t j = 0; j < outputSize; ++j)
+				weights[i][j] += learningRate * (error[j] - eta * weights[i][j]) * input[i];
+
+		return weights;
+	}
+
+	void benchmarkRelearning()
+	{
+		// One epoch presents the seven colour associations of the training (see dnf_architecture.cpp).
+		const double inputPositions[] = { 0.0, 41.0, 60.0, 120.0, 240.0, 274.0, 300.0 };
+		const double outputPositions[] = { 2.0, 6.0, 10.0, 14.0, 18.0, 22.0, 26.0 };
+		std::vector<std::vector<double>> inputs, targets;
+		for (int k = 0; k < 7; k++)
+		{
+			inputs.push_back(getGaussian(perceptualFieldSize, perceptualStepSize, inputPositions[k], 5.0));
+			targets.push_back(getGaussian(outputFieldSize, outputStepSize, outputPositions[k], 0.5));
+		}
+		constexpr double learningRate = 0.01;
+
+		std::cout << "Relearning of the " << perceptualFieldSize << " x " << outputFieldSize << " coupling, epochs of 7 associations per second\n";
+
+		std::vector<std::vector<double>> weights(perceptualFieldSize, std::vector<double>(outputFieldSize, 0.001));
+		const double byValue = measure([&] {
+			for (int k = 0; k < 7; k++)
+				weights = learningRuleByValue(weights, inputs[k], targets[k], learningRate);
+			sink = weights[0][0];
+		}, 5, 9);
+		std::cout << std::setw(44) << std::left << "  by value, all weights" << std::right << std::fixed << std::setprecision(0)
+			<< std::setw(10) << 1e6 / byValue << '\n';
+
+		const dnf_composer::element::FieldCouplingParameters parameters{ perceptualFieldSize, 0.4, learningRate, dnf_composer::LearningRule::DELTA_KROGH_HERTZ };
+		for (const double fraction : { 0.0, 0.14, 0.5 })
+		{
+			RelearningCoupling coupling({ "per - out", { 28, outputStepSize } }, parameters);
+			coupling.init();
+			coupling.setDegenerationSeed(1, 0, 1);
+			coupling.populateIndicesForDegeneration();
+			coupling.setDegeneracyType(experiment::degeneration::ElementDegeneracyType::WEIGHTS_DEACTIVATE);
+			coupling.degenerateFirst(static_cast<int>(fraction * coupling.getNumberOfCandidatesForDegeneration()));
+			coupling.setUpdateAllWeights(fraction == 0.0);
+
+			const double inPlace = measure([&] {
+				for (int k = 0; k < 7; k++)
+					coupling.updateWeights(inputs[k], targets[k]);
+				sink = coupling.getCouplingWeights()(0, 0);
+			}, 20, 9);
+			const std::string label = fraction == 0.0 ? "  in place, all weights"
+				: "  in place, keeping " + std::to_string(static_cast<int>(fraction * 100)) + "% degenerated";
+			std::cout << std::setw(44) << std::left << label << std::right << std::setw(10) << 1e6 / inPlace << '\n';
+		}
+		std::cout << "  (the old rule that kept degenerated weights searched the std::set of the remaining candidates for\n"
+			"   every weight, over ten minutes per association, and is not timed)" << std::endl << std::endl;
+	}
+
+	// DegenerateNeuralField::getCentroid before the single pass: a thresholded copy of the activation, a
+	// max_element pass and an fmod per neuron.
+	double getCentroidWithCopy(const std::vector<double>& activation, double stepSize)
+	{
+		std::vector<double> f_output(activation.size());
+		for (size_t i = 0; i < activation.size(); i++)
+			f_output[i] = activation[i] > 2.0 ? 1.0 : 0.0;
+		const double size = static_cast<double>(activation.size());
+		double centroid = 0.0;
+
+		if (*std::ranges::max_element(f_output) > 0)
+		{
+			const bool isAtLimits = (f_output[0] > 0) || (f_output.back() > 0);
+			double sumActivation = 0.0;
+			double sumWeightedPositions = 0.0;
+			for (size_t i = 0; i < activation.size(); i++)
+			{
+				sumActivation += f_output[i];
+				const double distance = isAtLimits ? fmod(static_cast<double>(i) - size * 0.5 + size * 10, size)
+					: fmod(static_cast<double>(i) - size * 0.5, size);
+				sumWeightedPositions += distance * f_output[i];
+			}
+			if (std::fabs(sumActivation) > 1e-6)
+			{
+				centroid = fmod(size * 0.5 + sumWeightedPositions / sumActivation, size);
+				if (isAtLimits)
+					centroid = (centroid >= 0 ? centroid : centroid + size);
+			}
+			centroid = centroid * stepSize + stepSize;
+		}
+		else
+			centroid = -1.0;
+		return centroid;
+	}
+
+	void benchmarkCentroid()
+	{
+		std::cout << "Field centroid, us per call (the peak covers about a tenth of the field)\n"
+			<< std::setw(10) << "neurons" << std::setw(10) << "peak" << std::setw(14) << "copy + fmod" << std::setw(14) << "single pass"
+			<< std::setw(14) << "difference" << '\n';
+
+		constexpr double stepSize = 0.5;
+		for (const int size : { 28, 360, 3600 })
+		{
+			for (const bool isAtLimits : { false, true })
+			{
+				// A bump above the threshold of 2.0, in the middle of the field or wrapped around its limits.
+				const double center = isAtLimits ? 0.0 : size * 0.5;
+				std::vector<double> activation(size);
+				for (int i = 0; i < size; i++)
+				{
+					const double distance = std::min(std::abs(i - center), size - std::abs(i - center));
+					activation[i] = 8.0 * std::exp(-0.5 * distance * distance / (size * size / 100.0)) - 5.0;
+				}
+
+				const int calls = 200000 / size + 1;
+				const double withCopy = measure([&] { sink = getCentroidWithCopy(activation, stepSize); }, calls);
+				const double singlePass = measure([&] { sink = DegenerateNeuralField::getCentroid(activation.data(), size, stepSize); }, calls);
+				const double difference = std::abs(getCentroidWithCopy(activation, stepSize) - DegenerateNeuralField::getCentroid(activation.data(), size, stepSize));
+
+				std::cout << std::setw(10) << size << std::setw(10) << (isAtLimits ? "limits" : "middle") << std::fixed << std::setprecision(3)
+					<< std::setw(14) << withCopy << std::setw(14) << singlePass << std::setw(14) << std::scientific << std::setprecision(1)
+					<< difference << '\n' << std::defaultfloat;
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	// DegenerateNeuralField::calculateActivation as it was before the buffers were resolved once: the components
+	// were looked up by name for every neuron.
+	void stepWithKeyedComponents(std::unordered_map<std::string, std::vector<double>>& components, const std::vector<double>& mask, double rate)
+	{
+		const int size = static_cast<int>(mask.size());
+		for (int i = 0; i < size; i++)
+			components["activation"][i] = (components["activation"][i]
+				+ rate * (-components["activation"][i] + components["resting level"][i] + components["input"][i])) * mask[i];
+	}
+
+	void benchmarkStep()
+	{
+		std::cout << "Euler step of both fields, us per step\n";
+		double keyed = 0.0, resolved = 0.0;
+		for (const int size : { perceptualFieldSize, outputFieldSize })
+		{
+			std::mt19937_64 generator(size);
+			std::unordered_map<std::string, std::vector<double>> components;
+			components["activation"].assign(size, -5.0);
+			components["resting level"].assign(size, -5.0);
+			components["input"] = getUniformValues(size, -1.0, 1.0, generator);
+			components["output"].assign(size, 0.0);
+			const std::vector<double> mask(size, 1.0);
+
+			keyed += measure([&] {
+				stepWithKeyedComponents(components, mask, 0.04);
+				sink = components["activation"][0];
+			}, 200);
+			std::vector<double>& activation = components["activation"];
+			const std::vector<double>& restingLevel = components["resting level"];
+			const std::vector<double>& input = components["input"];
+			resolved += measure([&] {
+				stepWithAliveMask(activation.data(), restingLevel.data(), input.data(), size, mask.data(), 0.04);
+				sink = activation[0];
+			}, 20000);
+		}
+		std::cout << std::fixed << std::setprecision(3) << "  looked up per neuron  " << std::setw(10) << keyed << '\n'
+			<< "  resolved in init()    " << std::setw(10) << resolved << '\n';
+
+		// The degenerate elements of the experiment simulation, stepped on the inputs of its other elements.
+		const std::shared_ptr<dnf_composer::Simulation> simulation = getExperimentSimulation();
+		simulation->init();
+		for (int i = 0; i < 100; i++)
+			simulation->step();
+		const std::shared_ptr<dnf_composer::element::Element> elements[] = {
+			simulation->getElement("perceptual field"), simulation->getElement("output field"), simulation->getElement("per - out") };
+		const double deltaT = 30.0;
+		const double elementsStep = measure([&] {
+			for (const auto& element : elements)
+				element->step(0.0, deltaT);
+		}, 2000, 25);
+		const double simulationStep = measure([&] { simulation->step(); }, 100, 9);
+		std::cout << "Step of the experiment simulation, us per step\n"
+			<< "  both fields and the coupling " << std::setw(10) << elementsStep << '\n'
+			<< "  all elements                 " << std::setw(10) << simulationStep << '\n' << std::endl;
+	}
+
+	// Activation of the perceptual field over the first steps of a trial: the stimulus of a colour forms a peak
+	// that then settles under the noise, as in the trials of the experiment.
+	std::vector<std::vector<double>> getPerceptualActivation(int numberOfSteps)
+	{
+		const std::shared_ptr<dnf_composer::Simulation> simulation = getExperimentSimulation();
+		const std::shared_ptr<dnf_composer::element::GaussStimulus> stimulus(new dnf_composer::element::GaussStimulus(
+			{ "stimulus", { 360, perceptualStepSize } }, { 25, 40, 120 }));
+		simulation->addElement(stimulus);
+		const std::shared_ptr<dnf_composer::element::Element> perceptualField = simulation->getElement("perceptual field");
+		perceptualField->addInput(stimulus);
+		simulation->init();
+
+		std::vector<std::vector<double>> activation;
+		for (int i = 0; i < numberOfSteps; i++)
+		{
+			simulation->step();
+			activation.push_back(*perceptualField->getComponentPtr("activation"));
+		}
+		return activation;
+	}
+
+	// A coupling fed from a stimulus element whose output is overwritten with the recorded activation.
+	struct ReplayedCoupling
+	{
+		std::shared_ptr<dnf_composer::element::GaussStimulus> source;
+		std::shared_ptr<DegenerateFieldCoupling> coupling;
+
+		explicit ReplayedCoupling(double degeneratedFraction)
+			: source(new dnf_composer::element::GaussStimulus({ "source", { 360, perceptualStepSize } }, { 25, 0, 0 })),
+			coupling(new DegenerateFieldCoupling({ "per - out", { 28, outputStepSize } },
+				{ perceptualFieldSize, 0.4, 0.01, dnf_composer::LearningRule::DELTA_KROGH_HERTZ }))
+		{
+			source->init();
+			coupling->addInput(source, "output");
+			coupling->init();
+			coupling->setDegenerationSeed(1, 0, 1);
+			coupling->populateIndicesForDegeneration();
+			coupling->setDegeneracyType(experiment::degeneration::ElementDegeneracyType::WEIGHTS_DEACTIVATE);
+			coupling->degenerateFirst(static_cast<int>(degeneratedFraction * coupling->getNumberOfCandidatesForDegeneration()));
+		}
+
+		void step(const std::vector<double>& activation)
+		{
+			std::ranges::copy(activation, source->getComponentPtr("output")->begin());
+			coupling->step(0.0, 30.0);
+		}
+	};
+
+	void benchmarkCoupling()
+	{
+		constexpr int numberOfSteps = 300;
+		const std::vector<std::vector<double>> trajectory = getPerceptualActivation(numberOfSteps);
+		const auto replay = [&](ReplayedCoupling& replayed) {
+			for (const std::vector<double>& activation : trajectory)
+				replayed.step(activation);
+			sink = (*replayed.coupling->getComponentPtr("output"))[0];
+		};
+
+		// The sparse product pays off below some density of the weights, which sets the default
+		// sparseCouplingDensity; the dense one is forced with a threshold of 0, the sparse one with 1.01.
+		std::cout << "Product of the " << perceptualFieldSize << " x " << outputFieldSize << " coupling, us per step\n"
+			<< std::setw(14) << "density" << std::setw(14) << "dense" << std::setw(14) << "sparse" << '\n';
+		for (const double fraction : { 0.0, 0.25, 0.5, 0.65, 0.75, 0.9 })
+		{
+			ReplayedCoupling replayed(fraction);
+			replayed.coupling->setSparseDensityThreshold(0.0);
+			const double dense = measure([&] { replay(replayed); }, 5, 9) / numberOfSteps;
+			replayed.coupling->setSparseDensityThreshold(1.01);
+			const double sparse = measure([&] { replay(replayed); }, 5, 9) / numberOfSteps;
+			std::cout << std::setw(14) << std::fixed << std::setprecision(2) << replayed.coupling->getDensity()
+				<< std::setprecision(3) << std::setw(14) << dense << std::setw(14) << sparse << '\n';
+		}
+		std::cout << '\n';
+
+		// The incremental output trades the tolerance on the inputs for the rows it skips; the error is the largest
+		// difference to the full product over the trial, relative to the largest output.
+		std::cout << "Incremental output of the coupling over the first " << numberOfSteps << " steps of a trial, dense weights\n"
+			<< std::setw(14) << "tolerance" << std::setw(14) << "resync" << std::setw(14) << "us per step" << std::setw(14) << "error" << '\n';
+		ReplayedCoupling full(0.0);
+		full.coupling->setSparseDensityThreshold(0.0);
+		const double fullProduct = measure([&] { replay(full); }, 5, 9) / numberOfSteps;
+		std::cout << std::setw(28) << "full product" << std::fixed << std::setprecision(3) << std::setw(14) << fullProduct << '\n';
+		for (const double tolerance : { 1e-4, 1e-3, 1e-2 })
+		{
+			for (const int resyncSteps : { 10, 100, 1000 })
+			{
+				ReplayedCoupling incremental(0.0);
+				incremental.coupling->setSparseDensityThreshold(0.0);
+				incremental.coupling->setIncrementalOutput(true, tolerance, resyncSteps);
+				const double time = measure([&] { replay(incremental); }, 5, 9) / numberOfSteps;
+
+				incremental.coupling->setIncrementalOutput(true, tolerance, resyncSteps);
+				double error = 0.0, largest = 0.0;
+				for (const std::vector<double>& activation : trajectory)
+				{
+					full.step(activation);
+					incremental.step(activation);
+					const std::vector<double>& exact = *full.coupling->getComponentPtr("output");
+					const std::vector<double>& approximate = *incremental.coupling->getComponentPtr("output");
+					for (int j = 0; j < outputFieldSize; j++)
+					{
+						error = std::max(error, std::abs(approximate[j] - exact[j]));
+						largest = std::max(largest, std::abs(exact[j]));
+					}
+				}
+
+				std::cout << std::setw(14) << std::scientific << std::setprecision(0) << tolerance << std::setw(14) << resyncSteps
+					<< std::fixed << std::setprecision(3) << std::setw(14) << time
+					<< std::setw(14) << std::scientific << std::setprecision(1) << (largest > 0.0 ? error / largest : 0.0)
+					<< '\n' << std::defaultfloat;
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	struct Benchmark
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	constexpr Benchmark benchmarks[] = {
+		{ "dead-neurons", benchmarkDeadNeurons },
+		{ "relearning", benchmarkRelearning },
+		{ "centroid", benchmarkCentroid },
+		{ "step", benchmarkStep },
+		{ "coupling", benchmarkCoupling },
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<const Benchmark*> selected;
+	for (int i = 1; i < argc; i++)
+	{
+		const auto benchmark = std::find_if(std::begin(benchmarks), std::end(benchmarks),
+			[&](const Benchmark& candidate) { return std::strcmp(candidate.name, argv[i]) == 0; });
+		if (benchmark == std::end(benchmarks))
+		{
+			std::cerr << "Unknown benchmark " << argv[i] << ". Usage: bench [";
+			for (const Benchmark& candidate : benchmarks)
+				std::cerr << ' ' << candidate.name;
+			std::cerr << " ]..." << std::endl;
+			return 1;
+		}
+		selected.push_back(benchmark);
+	}
+	if (selected.empty())
+		for (const Benchmark& benchmark : benchmarks)
+			selected.push_back(&benchmark);
+
+	for (const Benchmark* benchmark : selected)
+		benchmark->run();
+	return 0;
+}
@@ -0,0 +1,76 @@
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "results_store.h"
+
+// Converts centroid results between the text layout read by the analysis scripts and the binary files:
+// "<position> <name> - centroids.txt" becomes ".dnfr" and back. Single precision unless --double is given,
+// or encoded on the grid of the output field with --codec <d_x> <number of neurons>; --info only prints the
+// header and the number of records of binary files.
+int main(int argc, char* argv[])
+{
+	using namespace experiment::degeneration;
+
+	ResultsValueType valueType = ResultsValueType::FLOAT32;
+	double stepSize = 0.0;
+	int gridSize = 0;
+	bool isInfoOnly = false;
+	std::vector<std::filesystem::path> filenames;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string argument = argv[i];
+		if (argument == "--double")
+			valueType = ResultsValueType::FLOAT64;
+		else if (argument == "--codec" && i + 2 < argc)
+		{
+			valueType = ResultsValueType::CENTROID_CODEC;
+			stepSize = std::stod(argv[++i]);
+			gridSize = std::stoi(argv[++i]);
+		}
+		else if (argument == "--info")
+			isInfoOnly = true;
+		else
+			filenames.emplace_back(argument);
+	}
+
+	if (filenames.empty())
+	{
+		std::cerr << "Usage: results-converter [--double | --codec <d_x> <neurons>] [--info] <file.txt | file.dnfr>..." << std::endl;
+		return 1;
+	}
+
+	int numberOfFailures = 0;
+	for (const auto& filename : filenames)
+	{
+		std::filesystem::path convertedFilename = filename;
+		bool isConverted = false;
+		if (filename.extension() == ".dnfr" && isInfoOnly)
+		{
+			ResultsReader reader;
+			isConverted = reader.open(filename.string());
+			if (isConverted)
+			{
+				const ResultsFileHeader& header = reader.getHeader();
+				std::cout << filename.string() << ": " << header.name << " at " << header.position << ", "
+					<< reader.getNumberOfRecords() << " trials, "
+					<< (header.valueType == ResultsValueType::CENTROID_CODEC ? "encoded"
+						: (header.valueType == ResultsValueType::FLOAT32 ? "single precision" : "double precision")) << std::endl;
+			}
+		}
+		else if (filename.extension() == ".dnfr")
+			isConverted = convertResultsToText(filename.string(), convertedFilename.replace_extension(".txt").string());
+		else if (filename.extension() == ".txt")
+			isConverted = convertTextToResults(filename.string(), convertedFilename.replace_extension(".dnfr").string(), valueType, stepSize, gridSize);
+		else
+			std::cerr << "Skipping " << filename.string() << ", expected a .txt or .dnfr file." << std::endl;
+
+		if (!isConverted)
+			numberOfFailures++;
+		else if (!isInfoOnly)
+			std::cout << filename.string() << " -> " << convertedFilename.string() << std::endl;
+	}
+
+	return numberOfFailures == 0 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <string>
+
+#include "degenerate_field_coupling.h"
+#include "dnf_architecture.h"
+
+// Converts the text weights of the experiment's field coupling ("<coupling name>_weights.txt" in
+// data/weights-backup) to the binary weight file the coupling maps at init.
+// The header records the training checksum of the coupling as built by getExperimentSimulation() and
+// the size and write time of the text file, so the coupling rereads the text once it changes.
+int main()
+{
+	using namespace experiment::degeneration;
+
+	const std::shared_ptr<dnf_composer::Simulation> simulation = getExperimentSimulation();
+	const auto coupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(simulation->getElement("per - out"));
+	if (!coupling)
+	{
+		std::cerr << "The experiment simulation has no field coupling \"per - out\"." << std::endl;
+		return 1;
+	}
+
+	const std::string weightsFilename = coupling->getWeightsFilename();
+	const std::string textFilename = coupling->getTextWeightsFilename();
+	if (!convertTextToWeights(textFilename, weightsFilename, coupling->getTrainingChecksum(), coupling->getUniqueName()))
+		return 1;
+
+	std::cout << textFilename << " -> " << weightsFilename << std::endl;
+	return 0;
+}
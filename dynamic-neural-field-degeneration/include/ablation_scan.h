@@ -0,0 +1,89 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <simulation/simulation.h>
+
+#include "coupling_weights.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		enum class AblationTarget
+		{
+			WEIGHTS,
+			PRESYNAPTIC_NEURONS,
+			POSTSYNAPTIC_NEURONS
+		};
+
+		// Output field centroid after removing each element on its own (-1 where the peak vanished).
+		// Weight maps have one row per pre-synaptic and one column per post-synaptic neuron, neuron maps a single row.
+		struct AblationSensitivityMap
+		{
+			AblationTarget target = AblationTarget::WEIGHTS;
+			int rows = 0;
+			int cols = 0;
+			double baselineOutputFieldCentroid = -1;
+			std::vector<double> outputFieldCentroids;
+		};
+
+		// Single-element ablations of the "per - out" pathway, evaluated from a settled simulation.
+		// The perceptual field does not read the output field, so it is held at its settled state and every
+		// ablation is a rank-1 change of the output field input: removing weight (i, j) subtracts
+		// scalar * w(i, j) * u(i) from coupling output j, removing pre-synaptic neuron i (its activation
+		// u(i) dropping to zero, as with the alive mask) subtracts scalar * u(i) times row i of the weights, and
+		// removing post-synaptic neuron j masks it. Only the output field and its kernel are re-settled, for
+		// lanesPerBatch ablations at a time (trial-minor, as in BatchedSimulation) on a pool of threads.
+		// The noise input is held at its settled value, and the baseline is the unablated re-settle.
+		class AblationScan
+		{
+		public:
+			static constexpr int lanesPerBatch = 16;
+		private:
+			struct Lanes
+			{
+				AlignedVector activation, output, kernelOutput, input, aliveMask;
+				AlignedVector sums;
+				std::vector<double> scratch;
+			};
+
+			int numberOfSteps = 0;
+			int numberOfThreads = 1;
+
+			// output field
+			int size = 0;
+			double stepSize = 1.0;
+			double rate = 0.0; // deltaT / tau
+			double sigmoidXShift = 0.0;
+			double sigmoidSteepness = 1.0;
+			bool isFastSigmoidOn = false;
+			std::vector<double> restingLevel;
+			std::vector<double> settledActivation, settledOutput;
+			std::vector<double> heldInput; // coupling and noise kernel outputs of the settled state
+
+			// "out - out" kernel, folded into taps: output(i) += weight * input(i - offset), plus the global term
+			bool circular = true;
+			double amplitudeGlobal = 0.0;
+			std::vector<int> offsets;
+			std::vector<double> weights;
+			std::vector<double> settledKernelOutput;
+
+			// "per - out" coupling
+			CouplingWeights couplingWeights;
+			double couplingScalar = 1.0;
+			std::vector<double> presynapticActivation;
+		public:
+			AblationScan(const std::shared_ptr<dnf_composer::Simulation>& simulation, int numberOfSteps, int numberOfThreads);
+
+			AblationSensitivityMap scan(AblationTarget target) const;
+		private:
+			int getNumberOfElements(AblationTarget target) const;
+			// Settles the ablations of count elements, one per lane (-1 is no ablation), and stores their centroids.
+			void settleBatch(Lanes& lanes, AblationTarget target, const int* elements, int count, double* centroids) const;
+			void ablate(Lanes& lanes, AblationTarget target, int element, int lane) const;
+			void updateField(Lanes& lanes) const;
+			void convolve(Lanes& lanes) const;
+		};
+	}
+}
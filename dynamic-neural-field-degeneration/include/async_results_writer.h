@@ -0,0 +1,84 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "centroid_history.h"
+#include "results_store.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// A record for the writer thread: a binary results record (values, or the centroid history of a
+		// CENTROID_CODEC file, under the file header) or text that is appended to the file as is.
+		struct ResultsWriteRequest
+		{
+			std::string filename;
+			bool isBinary = false;
+			ResultsFileHeader header{};
+			std::uint32_t trial = 0;
+			std::uint32_t trialIndex = 0;
+			std::uint64_t seed = 0;
+			std::vector<double> values;
+			CentroidHistory centroidHistory;
+			std::string text;
+		};
+
+		struct ResultsWriterStatistics
+		{
+			std::uint64_t numberOfRecords = 0;
+			std::uint64_t numberOfWrites = 0;
+			std::uint64_t numberOfBytes = 0;
+			std::uint64_t numberOfBlockedPushes = 0;
+
+			std::string toString() const;
+		};
+
+		// Owns every results file of an experiment on a thread of its own. Producers (the experiment thread
+		// or the trial scheduler) only format and push records into a bounded queue, and block while it is
+		// full. The writer takes all queued records at once and hands each file its share with a single write.
+		// close() drains the queue and syncs the files to disk.
+		class AsyncResultsWriter
+		{
+		private:
+			std::size_t capacity;
+			mutable std::mutex mutex;
+			std::condition_variable isNotEmpty, isNotFull;
+			std::deque<ResultsWriteRequest> queue;
+			bool isClosing = false;
+			std::thread thread;
+			ResultsWriterStatistics statistics; // under the mutex
+
+			// writer thread only
+			std::unordered_map<std::string, std::unique_ptr<ResultsWriter>> resultsFiles;
+			std::unordered_map<std::string, std::FILE*> textFiles;
+			std::unordered_map<std::string, std::string> pendingText;
+			std::vector<std::uint8_t> encodedValues;
+		public:
+			explicit AsyncResultsWriter(std::size_t capacity = 64);
+			AsyncResultsWriter(const AsyncResultsWriter&) = delete;
+			AsyncResultsWriter& operator=(const AsyncResultsWriter&) = delete;
+			~AsyncResultsWriter();
+
+			void start();
+			void push(ResultsWriteRequest&& request);
+			void close();
+			ResultsWriterStatistics getStatistics() const;
+		private:
+			void run();
+			std::uint64_t write(std::vector<ResultsWriteRequest>& requests, std::uint64_t& numberOfWrites);
+			ResultsWriter* getResultsFile(const ResultsWriteRequest& request);
+			std::FILE* getTextFile(const std::string& filename);
+			void closeFiles();
+		};
+	}
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <simulation/simulation.h>
+
+#include "coupling_weights.h"
+#include "philox.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		enum class BatchedField
+		{
+			PERCEPTUAL,
+			OUTPUT
+		};
+
+		// B independent trajectories of the getExperimentSimulation() architecture advanced in lockstep.
+		// Every state is stored neuron-major and trial-minor (value (i, b) at i * laneStride + b, the lanes
+		// padded to a multiple of 4), so each field update, kernel convolution and coupling product is one
+		// pass over the neurons that updates all trials at once, with SIMD across the trials.
+		// Parameters, kernels, weights and the initial state are taken from an initialized simulation, and
+		// the element order of Simulation::step is kept; every lane owns its alive masks, weights and noise.
+		class BatchedSimulation
+		{
+		private:
+			struct Field
+			{
+				int size = 0;
+				double stepSize = 1.0;
+				double rate = 0.0; // deltaT / tau
+				double sigmoidXShift = 0.0;
+				double sigmoidSteepness = 1.0;
+				bool isFastSigmoidOn = false;
+				std::vector<double> restingLevel;
+				std::vector<double> initialActivation, initialOutput;
+				AlignedVector activation, output, aliveMask;
+			};
+
+			// Kernel folded into taps: output(i) += weight * input(i - offset), plus the global term.
+			struct Kernel
+			{
+				int size = 0;
+				bool circular = true;
+				double amplitudeGlobal = 0.0;
+				std::vector<int> offsets;
+				std::vector<double> weights;
+				std::vector<double> initialOutput;
+				AlignedVector output;
+			};
+
+			struct Noise
+			{
+				int size = 0;
+				double scale = 0.0; // amplitude / sqrt(deltaT), as in PhiloxNormalNoise::step
+				std::vector<PhiloxGenerator> generators; // one stream per lane
+				AlignedVector output;
+			};
+
+			struct PendingNeuron
+			{
+				int lane;
+				int index;
+			};
+
+			struct PendingWeight
+			{
+				int lane;
+				int row;
+				int col;
+				double value;
+			};
+
+			int batchSize = 0;
+			int laneStride = 0;
+			double deltaT = 1.0;
+			std::uint64_t numberOfSteps = 0;
+
+			Field perceptualField, outputField;
+			Kernel perceptualKernel, outputKernel, perceptualNoiseKernel, outputNoiseKernel;
+			Noise perceptualNoise, outputNoise;
+
+			int couplingRows = 0;
+			int couplingCols = 0;
+			double couplingScalar = 1.0;
+			std::vector<double> initialWeights; // weight (row, col) at col * rows + row
+			AlignedVector weights;              // weight (row, col) of lane b at (col * rows + row) * laneStride + b
+			std::vector<double> initialCouplingOutput;
+			AlignedVector couplingOutput;
+			AlignedVector externalInput; // added to the perceptual field input, zero without a stimulus
+
+			// Degenerations take effect where DegenerateNeuralField and DegenerateFieldCoupling apply them:
+			// after the field (coupling) update of the next step.
+			std::vector<PendingNeuron> pendingPerceptualNeurons, pendingOutputNeurons;
+			std::vector<PendingWeight> pendingWeights;
+
+			AlignedVector laneSums;
+			std::vector<double> laneScratch;
+		public:
+			BatchedSimulation(const std::shared_ptr<dnf_composer::Simulation>& simulation, int batchSize);
+
+			// Puts the lane back in the state of the initialized simulation (full fields and weights, no input).
+			void resetLane(int lane);
+			// Adds the output of a stimulus to the perceptual field input of the lane; an empty vector removes it.
+			void setExternalInput(int lane, const std::vector<double>& input);
+			void setNoiseStreams(int lane, std::uint64_t seed, std::uint64_t perceptualStream, std::uint64_t outputStream);
+			void deactivateNeuron(int lane, BatchedField field, int index);
+			void setWeight(int lane, int row, int col, double value);
+			double getWeight(int lane, int row, int col) const;
+
+			void step();
+
+			double getCentroid(int lane, BatchedField field);
+			int getBatchSize() const;
+			int getFieldSize(BatchedField field) const;
+			int getCouplingRows() const;
+			int getCouplingCols() const;
+			std::uint64_t getNumberOfSteps() const;
+		private:
+			void initializeField(Field& field, const std::shared_ptr<dnf_composer::element::Element>& element);
+			void initializeKernel(Kernel& kernel, const std::shared_ptr<dnf_composer::element::Element>& element);
+			void initializeNoise(Noise& noise, const std::shared_ptr<dnf_composer::element::Element>& element);
+
+			void updateField(Field& field, const AlignedVector& input0, const AlignedVector& input1, const AlignedVector& input2);
+			void convolve(Kernel& kernel, const AlignedVector& input);
+			void multiplyCoupling();
+			void generateNoise(Noise& noise);
+			void applyPendingNeurons(Field& field, std::vector<PendingNeuron>& pending);
+			void applyPendingWeights();
+
+			Field& getField(BatchedField field);
+			void setLane(AlignedVector& values, int lane, const std::vector<double>& source) const;
+		};
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Run-length and delta encoded field centroids. A centroid is the mean position of the active neurons,
+		// d_x * (i + a / n) with n active neurons, and the peak moves by a few neurons at most between
+		// degeneration steps, so each run of equal centroids is coded from its grid index i (as the change
+		// from the previous run) and its fraction a / n:
+		//   byte 0: kind (bits 7-6) | zigzag index change (bits 5-3, 7: varint follows) | run length - 1 (bits 2-0, 7: varint of length - 8 follows)
+		//   kind 0: on the grid, 1: half-way, 2: varints n and a follow, 3: one more byte, 0 for no peak (-1)
+		//   or 1 for a literal float.
+		// Encoding is lossless at single precision, the precision the results files record, or at the given
+		// number of significant digits for centroids read back from text.
+		class CentroidHistory
+		{
+		private:
+			struct EncoderState
+			{
+				std::int64_t gridIndex = 0;
+				int denominator = 2;
+			};
+
+			double stepSize = 0.0;
+			int maxDenominator = 0;
+			std::vector<std::uint8_t> bytes; // completed runs
+			EncoderState state;
+			double runValue = 0.0;
+			std::uint64_t runLength = 0;
+			std::size_t numberOfValues = 0;
+		public:
+			CentroidHistory() = default;
+			// maxDenominator is the number of neurons of the field, the most that can be active.
+			CentroidHistory(double stepSize, int maxDenominator);
+
+			void setGrid(double stepSize, int maxDenominator);
+			void push_back(double centroid);
+			void clear();
+
+			std::size_t size() const;
+			bool empty() const;
+			double getStepSize() const;
+			int getMaxDenominator() const;
+			std::size_t getNumberOfBytes() const;
+
+			void encode(std::vector<std::uint8_t>& encoded) const;
+			void decode(std::vector<double>& centroids) const;
+			// Fails on truncated or malformed runs and on runs that do not add up to numberOfValues.
+			static bool decode(const std::uint8_t* encoded, std::size_t numberOfBytes, std::size_t numberOfValues, double stepSize,
+				std::vector<double>& centroids);
+			static void encode(const double* centroids, std::size_t count, double stepSize, int maxDenominator, std::vector<std::uint8_t>& encoded,
+				int significantDigits = 0);
+		private:
+			static void appendRun(std::vector<std::uint8_t>& encoded, EncoderState& state, double value, std::uint64_t length,
+				double stepSize, int maxDenominator, int significantDigits = 0);
+		};
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <complex>
+#include <vector>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Circular convolution of a signal of size N with a fixed kernel through a radix-2 FFT.
+		// The linear convolution is computed on M >= 2N - 1 (a power of two) samples and folded back
+		// onto N; the spectrum of the kernel is computed once, in setKernel().
+		class CircularConvolution
+		{
+		private:
+			int size = 0;
+			int transformSize = 0;
+			std::vector<int> bitReversal;
+			std::vector<std::complex<double>> twiddles;
+			std::vector<std::complex<double>> kernelSpectrum;
+			std::vector<std::complex<double>> workspace;
+		public:
+			CircularConvolution() = default;
+
+			// circularKernel[d] weighs input[(i - d) mod N] in output[i].
+			void setKernel(const std::vector<double>& circularKernel);
+			void convolve(const double* input, double* output);
+
+			int getSize() const;
+			int getTransformSize() const;
+
+			// Rough operation count of one convolution, to compare with a direct one (N * kernel length).
+			static double estimateCost(int size);
+		private:
+			void transform(std::vector<std::complex<double>>& data, bool inverse) const;
+		};
+	}
+}
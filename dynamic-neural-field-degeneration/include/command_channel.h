@@ -0,0 +1,143 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <string>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		using CommandClock = std::chrono::steady_clock;
+
+		// Bounded single-producer/single-consumer ring buffer. The producer only writes the tail and
+		// the consumer only writes the head; each index lives on its own cache line.
+		template<typename T, size_t Capacity>
+		class SpscQueue
+		{
+			static_assert((Capacity & (Capacity - 1)) == 0, "The capacity must be a power of two.");
+		private:
+			alignas(64) std::atomic<size_t> head = 0;
+			alignas(64) std::atomic<size_t> tail = 0;
+			alignas(64) std::array<T, Capacity> slots;
+		public:
+			bool tryPush(T&& value)
+			{
+				const size_t currentTail = tail.load(std::memory_order_relaxed);
+				if (currentTail - head.load(std::memory_order_acquire) == Capacity)
+					return false;
+				slots[currentTail & (Capacity - 1)] = std::move(value);
+				tail.store(currentTail + 1, std::memory_order_release);
+				return true;
+			}
+
+			std::optional<T> tryPop()
+			{
+				const size_t currentHead = head.load(std::memory_order_relaxed);
+				if (currentHead == tail.load(std::memory_order_acquire))
+					return std::nullopt;
+				std::optional<T> value = std::move(slots[currentHead & (Capacity - 1)]);
+				head.store(currentHead + 1, std::memory_order_release);
+				return value;
+			}
+
+			bool isEmpty() const
+			{
+				return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+			}
+		};
+
+		// Handoff latency of commands: from the push to the start of their execution (measured by
+		// the consumer), and from the push until the waiting producer has woken up (measured by the producer).
+		struct CommandLatencyStatistics
+		{
+			std::uint64_t numberOfHandoffs = 0;
+			double totalHandoffMicroseconds = 0;
+			double maxHandoffMicroseconds = 0;
+			std::uint64_t numberOfRoundTrips = 0;
+			double totalRoundTripMicroseconds = 0;
+			double maxRoundTripMicroseconds = 0;
+
+			void addHandoff(CommandClock::time_point pushTime, CommandClock::time_point startTime);
+			void addRoundTrip(CommandClock::time_point pushTime, CommandClock::time_point wakeTime);
+			std::string toString() const;
+		};
+
+		// Commands from one producer thread to one consumer thread, with a completion counter in the other
+		// direction. The producer blocks in std::atomic::wait (a futex on Linux, WaitOnAddress on Windows)
+		// until its command has been executed, so waiting does not burn a core.
+		template<typename Command, size_t Capacity = 16>
+		class CommandChannel
+		{
+		private:
+			struct Envelope
+			{
+				Command command;
+				CommandClock::time_point pushTime;
+			};
+
+			SpscQueue<Envelope, Capacity> queue;
+			alignas(64) std::atomic<std::uint64_t> numberOfCompletedCommands = 0;
+			std::uint64_t numberOfPushedCommands = 0; // producer side only
+			CommandClock::time_point lastPushTime;    // producer side only
+			CommandLatencyStatistics producerStatistics, consumerStatistics;
+		public:
+			// Producer: enqueues the command, waiting for a free slot if the queue is full.
+			void push(Command command)
+			{
+				lastPushTime = CommandClock::now();
+				Envelope envelope{ std::move(command), lastPushTime };
+				while (!queue.tryPush(std::move(envelope)))
+					waitForCompletion(numberOfCompletedCommands.load(std::memory_order_acquire) + 1);
+				numberOfPushedCommands++;
+			}
+
+			// Producer: blocks until every pushed command has been executed.
+			void waitForAll()
+			{
+				if (numberOfCompletedCommands.load(std::memory_order_acquire) == numberOfPushedCommands)
+					return;
+				waitForCompletion(numberOfPushedCommands);
+				producerStatistics.addRoundTrip(lastPushTime, CommandClock::now());
+			}
+
+			// Consumer: executes at most one pending command, then signals its completion.
+			template<typename Execute>
+			bool tryExecute(Execute&& execute)
+			{
+				std::optional<Envelope> envelope = queue.tryPop();
+				if (!envelope)
+					return false;
+				consumerStatistics.addHandoff(envelope->pushTime, CommandClock::now());
+				execute(envelope->command);
+				numberOfCompletedCommands.fetch_add(1, std::memory_order_release);
+				numberOfCompletedCommands.notify_one();
+				return true;
+			}
+
+			// Only consistent once the producer has returned from waitForAll().
+			CommandLatencyStatistics getLatencyStatistics() const
+			{
+				CommandLatencyStatistics statistics = producerStatistics;
+				statistics.numberOfHandoffs = consumerStatistics.numberOfHandoffs;
+				statistics.totalHandoffMicroseconds = consumerStatistics.totalHandoffMicroseconds;
+				statistics.maxHandoffMicroseconds = consumerStatistics.maxHandoffMicroseconds;
+				return statistics;
+			}
+		private:
+			void waitForCompletion(std::uint64_t target)
+			{
+				std::uint64_t completed = numberOfCompletedCommands.load(std::memory_order_acquire);
+				while (completed < target)
+				{
+					numberOfCompletedCommands.wait(completed, std::memory_order_acquire);
+					completed = numberOfCompletedCommands.load(std::memory_order_acquire);
+				}
+			}
+		};
+	}
+}
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		template<typename T, std::size_t Alignment>
+		struct AlignedAllocator
+		{
+			using value_type = T;
+
+			template<typename U>
+			struct rebind { using other = AlignedAllocator<U, Alignment>; };
+
+			AlignedAllocator() noexcept = default;
+			template<typename U>
+			AlignedAllocator(const AlignedAllocator<U, Alignment>&) noexcept {}
+
+			T* allocate(std::size_t n)
+			{
+				return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Alignment }));
+			}
+
+			void deallocate(T* p, std::size_t) noexcept
+			{
+				::operator delete(p, std::align_val_t{ Alignment });
+			}
+
+			template<typename U>
+			bool operator==(const AlignedAllocator<U, Alignment>&) const noexcept { return true; }
+		};
+
+		using AlignedVector = std::vector<double, AlignedAllocator<double, 64>>;
+
+		// Contiguous, 64-byte aligned weight matrix of a field coupling.
+		// Rows are the input (pre-synaptic) neurons and columns the output (post-synaptic) neurons,
+		// i.e. entry (i, j) is weights[i][j] of dnf_composer::element::FieldCoupling.
+		// Each row is padded with zeros to a multiple of 8 doubles so every row starts on a cache line.
+		// A view (see view()) reads rows in the same layout owned elsewhere, e.g. a mapped weight file;
+		// it is read-only, and a copy of it owns its values again.
+		class CouplingWeights
+		{
+		public:
+			static constexpr int alignment = 64;
+			static constexpr int rowAlignmentInElements = alignment / sizeof(double);
+		private:
+			int rows = 0;
+			int cols = 0;
+			int stride = 0;
+			AlignedVector values;
+			const double* viewed = nullptr;
+			std::shared_ptr<const void> viewedOwner; // keeps the viewed rows alive
+		public:
+			CouplingWeights() = default;
+			CouplingWeights(const CouplingWeights& other);
+			CouplingWeights(CouplingWeights&& other) noexcept = default;
+			CouplingWeights& operator=(const CouplingWeights& other);
+			CouplingWeights& operator=(CouplingWeights&& other) noexcept = default;
+
+			// data must be 64-byte aligned, with rows of stride doubles (a multiple of 8) padded with zeros.
+			static CouplingWeights view(const double* data, int rows, int cols, int stride, std::shared_ptr<const void> owner);
+			bool isView() const { return viewed != nullptr; }
+
+			void resize(int rows, int cols);
+			void assign(const std::vector<std::vector<double>>& weights);
+			void copyTo(std::vector<std::vector<double>>& weights) const;
+			void fill(double value);
+
+			double& operator()(int row, int col) { return values[static_cast<size_t>(row) * stride + col]; }
+			double operator()(int row, int col) const { return data()[static_cast<size_t>(row) * stride + col]; }
+			double* row(int row) { return values.data() + static_cast<size_t>(row) * stride; }
+			const double* row(int row) const { return data() + static_cast<size_t>(row) * stride; }
+			double* data() { return values.data(); }
+			const double* data() const { return viewed ? viewed : values.data(); }
+
+			int getRows() const { return rows; }
+			int getCols() const { return cols; }
+			int getStride() const { return stride; }
+			int countNonZeros() const;
+
+			// output[j] = scalar * sum_i weights(i, j) * input[i], for j < cols.
+			void multiplyTransposed(const double* input, double* output, double scalar) const;
+		};
+
+		// Compressed sparse column copy of a CouplingWeights matrix: the non-zero weights of each output
+		// neuron are stored contiguously with their (ascending) input indices, so the product skips
+		// deactivated weights. Weights zeroed through set() stay stored until compact().
+		class SparseCouplingWeights
+		{
+		private:
+			int rows = 0;
+			int cols = 0;
+			std::vector<int> columnStarts; // the entries of column j are [columnStarts[j], columnStarts[j + 1])
+			std::vector<int> rowIndices;
+			AlignedVector values;
+			int numberOfStoredZeros = 0;
+		public:
+			SparseCouplingWeights() = default;
+
+			void assign(const CouplingWeights& weights);
+			// Updates a stored weight in place. Returns false if the weight is not stored and the value is
+			// non-zero; the copy is then out of date and has to be assigned again.
+			bool set(int row, int col, double value);
+			// Drops the stored zeros.
+			void compact();
+
+			int getNumberOfEntries() const { return static_cast<int>(values.size()); }
+			int getNumberOfStoredZeros() const { return numberOfStoredZeros; }
+
+			// Same product as CouplingWeights::multiplyTransposed.
+			void multiplyTransposed(const double* input, double* output, double scalar) const;
+		};
+
+		// Weights of one coupling as an immutable base, shared by the couplings of every simulation in the
+		// process, and the weights this coupling changed (deactivated, randomized or reduced), listed per
+		// row with their difference to the base. Resetting a trial clears the changes. The product is the
+		// base product corrected by the changes, until more than 1/materializationDivisor of the weights
+		// changed (or a learning step changes them all): the weights are then materialized into a private
+		// dense copy, which is dropped again by the next reset.
+		class OverlayCouplingWeights
+		{
+		public:
+			static constexpr int materializationDivisor = 64;
+		private:
+			struct Change
+			{
+				int col;
+				double value;
+				double delta; // value - base
+			};
+
+			std::shared_ptr<const CouplingWeights> base;
+			int baseNonZeros = 0;
+			std::vector<std::vector<Change>> rowChanges;
+			std::vector<int> changedRows;
+			int numberOfChanges = 0;
+			CouplingWeights dense;
+			bool isDense = false;
+		public:
+			OverlayCouplingWeights() = default;
+
+			void setBase(std::shared_ptr<const CouplingWeights> base);
+			const std::shared_ptr<const CouplingWeights>& getBase() const { return base; }
+			void reset();
+
+			double operator()(int row, int col) const;
+			void set(int row, int col, double value);
+
+			int getRows() const { return base ? base->getRows() : 0; }
+			int getCols() const { return base ? base->getCols() : 0; }
+			int getStride() const { return base ? base->getStride() : 0; }
+			int getNumberOfChanges() const { return numberOfChanges; }
+			// Rows with changes to the base, in the order they were first changed (empty once materialized).
+			const std::vector<int>& getChangedRows() const { return changedRows; }
+			bool isMaterialized() const { return isDense; }
+			int countNonZeros() const;
+
+			// The dense weights: the base while nothing changed, otherwise the (materialized) private copy,
+			// which the caller may change in place.
+			const CouplingWeights& getDense();
+			CouplingWeights& materialize();
+			void copyTo(CouplingWeights& weights) const;
+			void copyTo(std::vector<std::vector<double>>& weights) const;
+			// weights[j] = (*this)(row, j), for j < cols.
+			void copyRowTo(int row, double* weights) const;
+
+			// Same product as CouplingWeights::multiplyTransposed.
+			void multiplyTransposed(const double* input, double* output, double scalar) const;
+			// sums[j] += factor * weights(row, j), for j < cols.
+			void addScaledRow(int row, double factor, double* sums) const;
+		};
+	}
+}
@@ -5,13 +5,41 @@
 #include <elements/field_coupling.h>
 
 #include "degeneration_parameters.h"
+#include "degeneration_order.h"
+#include "coupling_weights.h"
+#include "philox.h"
+#include "weights_store.h"
 
 class DegenerateFieldCoupling : public dnf_composer::element::FieldCoupling
 {
 private:
 	experiment::degeneration::ElementDegeneracyType degeneracyType;
 	bool degenerate;
-	std::set<std::pair<int, int>> indicesForDegeneration;
+	experiment::degeneration::DegenerationOrder degenerationOrder;
+	experiment::degeneration::PhiloxGenerator randomValueGenerator; // private per element, so parallel simulations do not share state
+	std::uint64_t valueStream = 1; // stream of the random values, under the seed of the degeneration order
+	experiment::degeneration::OverlayCouplingWeights couplingWeights; // shared trained weights and this trial's changes
+	std::vector<int> degeneratedWeights; // taken for degeneration this trial, kept by the learning rule
+	experiment::degeneration::SparseCouplingWeights sparseWeights; // product while the density is below the threshold
+	double sparseDensityThreshold = 0.0; // off; the sparse product overtakes the dense one near a density of 0.65 (bench coupling)
+	int numberOfNonZeroWeights = 0;
+	bool isSparse = false;
+	bool isSparseOutdated = true; // set by bulk changes of the weights, the sparse copy is then assigned again
+	bool isIncrementalOutputOn = false;
+	bool isIncrementalOutputValid = false;
+	double incrementalInputTolerance = 1e-3; // a tenth of the full product's time for a relative error near 2e-5 (bench coupling)
+	int incrementalResyncSteps = 100;
+	int stepsSinceResync = 0;
+	experiment::degeneration::AlignedVector lastInput, incrementalSums; // input and unscaled output of the incremental product
+	std::vector<int> changedInputs;
+	experiment::degeneration::AlignedVector actualOutput, error; // scratch of the learning rule
+	experiment::degeneration::CouplingWeights plasticityMask; // 1.0 while a weight has not degenerated
+	bool isPlasticityMaskValid = false;
+	std::vector<double>* input = nullptr;  // component buffers resolved in init(), see DegenerateNeuralField
+	std::vector<double>* output = nullptr;
+	bool areWeightsSynchronized = true; // false when every row of the base class weights is out of date
+	std::vector<int> unsynchronizedRows; // otherwise only these rows are
+	std::vector<unsigned char> isRowUnsynchronized;
 	double minWeightValue = 0;
 	double maxWeightValue = 0;
 	double weightReductionFactor = 0.005;
@@ -30,18 +58,42 @@ public:
 	int getNumIndicesForDegeneration() const;
 	void setDegeneracyType(experiment::degeneration::ElementDegeneracyType degeneracyType);
 	void setNumWeightsToDegenerate(int count);
+	void setDegenerationSeed(std::uint64_t seed, std::uint64_t orderStream, std::uint64_t valueStream);
 	experiment::degeneration::ElementDegeneracyType getDegeneracyType() const;
 	virtual void updateWeights(const std::vector<double>& input, const std::vector<double>& output);
 	void populateIndicesForDegeneration();
+	void degenerateFirst(int count);
+	int getNumberOfCandidatesForDegeneration() const;
+	const experiment::degeneration::OverlayCouplingWeights& getCouplingWeights() const;
+	double getScalar() const;
+	double getWeightReductionFactor() const;
+	double getMinWeightValue() const;
+	double getMaxWeightValue() const;
+	void setCouplingWeights(const experiment::degeneration::OverlayCouplingWeights& couplingWeights);
+	void synchronizeWeights();
+	void setSparseDensityThreshold(double threshold);
+	double getDensity() const;
+	bool isSparseProductOn() const;
+	void setIncrementalOutput(bool isIncrementalOutputOn, double inputTolerance, int resyncSteps);
+	std::string getWeightsFilename() const;
+	std::string getTextWeightsFilename() const;
+	std::uint64_t getTrainingChecksum() const;
 private:
+	bool loadMappedWeights();
+	void clearComponents();
 	void setRandomWeightToRandomValue();
 	void setRandomWeightToReduceValue();
-	void setRandomUniqueWeightToZero();
+	void degenerateNextWeight();
 	void findMinMaxWeightValues();
-	double getWeightReductionFactor() const;
-	void setRandomUniqueWeightToReduceValue();
-	void setRandomUniqueWeightToRandomValue();
+	bool takeNextWeightForDegeneration(int& row_idx, int& col_idx);
+	void degenerateWeight(int row_idx, int col_idx);
+	void setWeight(int row_idx, int col_idx, double value);
+	void markRowUnsynchronized(int row_idx);
+	void invalidateWeightCaches();
+	void updatePlasticityMask();
+	void updateProductRepresentation();
+	void multiply(const double* input, double* output, double scalar);
+	void updateOutputIncrementally();
 
-	std::vector<std::vector<double>> learningRuleDegenerate(std::vector<std::vector<double>>& weights,
-		const std::vector<double>& input, const std::vector<double>& targetOutput, const double& learningRate) const;
+	void learningRuleDegenerate(const std::vector<double>& input, const std::vector<double>& targetOutput, const double& learningRate);
 };
\ No newline at end of file
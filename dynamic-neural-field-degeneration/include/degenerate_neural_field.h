@@ -4,15 +4,50 @@
 #include <elements/neural_field.h>
 
 #include "degeneration_parameters.h"
+#include "degeneration_order.h"
 
 
 class DegenerateNeuralField : public dnf_composer::element::NeuralField
 {
 private:
+	// Component buffers resolved once instead of looked up by name in every step. These point to the
+	// vectors (stable map nodes), not to their data, since the base class may reassign a component's buffer.
+	struct ComponentHandles
+	{
+		std::vector<double>* activation = nullptr;
+		std::vector<double>* restingLevel = nullptr;
+		std::vector<double>* input = nullptr;
+		std::vector<double>* output = nullptr;
+	};
+
+	struct ActiveNeuronSums
+	{
+		std::int64_t count = 0;
+		std::int64_t sumOfIndices = 0;
+		std::int64_t countInLowerHalf = 0;
+	};
+
+public:
+	// Parameters of the fused activation and output sweep (see setSigmoidOutput).
+	struct FusedDynamics
+	{
+		double tau = 1.0;
+		double sigmoidXShift = 0.0;
+		double sigmoidSteepness = 1.0;
+		bool isFastSigmoidOn = false;
+	};
+private:
+	static constexpr double centroidThreshold = 2.0; // activation above which a neuron counts towards the centroid
 	experiment::degeneration::ElementDegeneracyType degeneracyType;
 	bool degenerate;
-	std::vector<int> indicesForDegeneration;
-	std::vector<int> degeneratedIndices;
+	experiment::degeneration::DegenerationOrder degenerationOrder;
+	std::vector<double> aliveMask; // 1.0 for healthy neurons, 0.0 for "killed" ones
+	ComponentHandles componentHandles;
+	// Sigmoid output evaluated in the same sweep as the activation (see setSigmoidOutput).
+	bool isOutputFused = false;
+	bool isFastSigmoidOn = false;
+	double sigmoidXShift = 0.0;
+	double sigmoidSteepness = 1.0;
 	int numNeuronsToDegenerate = 1;
 public:
 	DegenerateNeuralField(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
@@ -27,11 +62,22 @@ public:
 
 	void setDegeneracyType(experiment::degeneration::ElementDegeneracyType degeneracyType);
 	void setNumNeuronsToDegenerate(const int& numNeuronsToDegenerate);
+	void setDegenerationSeed(std::uint64_t seed, std::uint64_t stream);
+	void setSigmoidOutput(double xShift, double steepness);
+	void setFastSigmoid(bool isFastSigmoidOn);
 	experiment::degeneration::ElementDegeneracyType getDegeneracyType() const;
 	double getCentroid();
+	FusedDynamics getFusedDynamics() const;
+	const std::vector<double>& getAliveMask() const;
+	static double getCentroid(const double* activation, int size, double stepSize);
 	void populateIndicesForDegeneration();
 	void clearDegeneration();
+	void degenerateFirst(int count);
+	int getNumberOfCandidatesForDegeneration() const;
 private:
 	void setRandomUniqueNeuronToZero();
+	void resolveComponentHandles();
 	void calculateActivation(const double& t, const double& deltaT);
+	void calculateActivationAndOutput(const double& deltaT);
+	static ActiveNeuronSums sumActiveNeurons(const double* activation, int size, double threshold);
 };
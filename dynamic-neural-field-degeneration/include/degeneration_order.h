@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Order in which the elements of a degenerate element are killed during a trial.
+		// All candidate indices are shuffled once per trial (Fisher-Yates on the Philox stream (seed, stream))
+		// and handed out with a cursor, so each pick is O(1) and the first k victims are known up front.
+		class DegenerationOrder
+		{
+		private:
+			std::vector<int> order;
+			std::vector<int> positionInOrder;
+			int cursor = 0;
+			std::uint64_t seed = 0;
+			std::uint64_t stream = 0;
+			bool isSeeded = false;
+		public:
+			DegenerationOrder() = default;
+
+			void reset(int numberOfCandidates);
+			void rewind();
+			void clear();
+			void setSeed(std::uint64_t seed, std::uint64_t stream = 0);
+
+			int next();
+			std::span<const int> takeFirst(int count);
+
+			bool isTaken(int index) const;
+			bool isExhausted() const;
+			int getNumberOfCandidates() const;
+			int getNumberOfTaken() const;
+			int getNumberOfRemaining() const;
+			std::span<const int> getTaken() const;
+			std::uint64_t getSeed() const;
+			std::uint64_t getStream() const;
+		private:
+			void shuffle();
+		};
+	}
+}
@@ -34,6 +34,7 @@ namespace experiment
 			double incrementOfDegenerationInPercentage;
 
 			DegenerationParameters();
+			DegenerationParameters(ElementDegeneracyType type, const std::string& field);
 			void read();
 			std::string toString() const;
 			void print() const;
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <map>
+#include <mutex>
 #include <thread>
 #include <application/application.h>
 #include <user_interface/element_window.h>
@@ -8,10 +11,16 @@
 #include <user_interface/simulation_window.h>
 #include <user_interface/plot_window.h>
 
+#include "centroid_history.h"
+#include "command_channel.h"
 #include "degenerate_field_coupling.h"
 #include "degenerate_neural_field.h"
 #include "degeneration_parameters.h"
 #include "dnf_architecture.h"
+#include "experiment_parameters.h"
+#include "philox_normal_noise.h"
+#include "seqlock.h"
+#include "simulation_checkpoint.h"
 #include "user_interface_window.h"
 
 namespace experiment
@@ -22,6 +31,7 @@ namespace experiment
 		{
 			std::shared_ptr<DegenerateNeuralField> inputField, outputField;
 			std::shared_ptr<DegenerateFieldCoupling> fieldCoupling;
+			std::shared_ptr<PhiloxNormalNoise> inputNoise, outputNoise;
 		};
 
 		struct SimulationParameters
@@ -29,21 +39,112 @@ namespace experiment
 			std::string inputFieldId = "perceptual field";
 			std::string outputFieldId = "output field";
 			std::string fieldCouplingId = "per - out";
+			std::string inputNoiseId = "noise per";
+			std::string outputNoiseId = "noise out";
 			double externalInputPosition = 0;
-			double inputFieldCentroid, outputFieldCentroid;
 			int timeForFieldToSettle = 25;
 			ElementDegeneracyType degeneracyType = ElementDegeneracyType::NONE;
 			std::string fieldToDegenerate = "perceptual";
 
 			bool isDebugMode = false;
 			bool isUserInterfaceActive = false;
+			bool isHeadless = false;
+
+			// Adaptive settling stops once the max-abs change of both field activations stays below
+			// the tolerance for settlingStableSteps consecutive steps, or after maxTimeForFieldToSettle steps.
+			bool isSettlingAdaptive = false;
+			double settlingTolerance = 1e-3;
+			int settlingStableSteps = 5;
+			int maxTimeForFieldToSettle = 500;
+
+			// Settled state after the external input, cached per stimulus position.
+			bool isSettledStateCacheOn = false;
+			bool reseedNoiseOnRestore = true;
+
+			// Trial t draws from the Philox streams t * RandomStream::COUNT + purpose under this seed.
+			std::uint64_t randomSeed = 0;
+		};
+
+		enum class RandomStream
+		{
+			PERCEPTUAL_FIELD_ORDER,
+			OUTPUT_FIELD_ORDER,
+			COUPLING_ORDER,
+			COUPLING_VALUES,
+			PERCEPTUAL_NOISE,
+			OUTPUT_NOISE,
+			COUNT
+		};
+
+		std::uint64_t getRandomStream(int trialIndex, RandomStream purpose);
+		// Noise streams of the settling that the settled state cache captures for a stimulus position. They lie
+		// in the upper half of the stream space, away from every trial's streams, and depend on the position only.
+		std::uint64_t getSettlingStream(double position, RandomStream purpose);
+
+		// Settled states shared by the handlers of the workers of a TrialScheduler. A position settles from its
+		// own noise streams, so every handler captures the same state for it, whichever trial settles it first.
+		class SettledStateStore
+		{
+		private:
+			std::mutex mutex;
+			std::map<double, SimulationCheckpoint> checkpoints;
+		public:
+			// Copies the values of the state settled at position into checkpoint, false if there is none yet.
+			bool copyTo(double position, SimulationCheckpoint& checkpoint);
+			void add(double position, const SimulationCheckpoint& checkpoint);
+		};
+
+		// Smallest number of degenerated elements at which the output field peak vanishes
+		// or drifts past the decision tolerance (numberOfCandidates + 1 if it never fails).
+		struct DegenerationThreshold
+		{
+			int numberOfElements = 0;
+			int numberOfCandidates = 0;
+			double outputFieldCentroid = -1;
+			double outputFieldCentroidBeforeThreshold = -1;
+			int numberOfSettles = 0;
+		};
+
+		enum class SimulationCommandType
+		{
+			SET_EXTERNAL_INPUT,
+			APPLY_DEGENERATION,
+			CLEAN_UP_TRIAL,
+			START_TRIAL
+		};
+
+		// Request from the experiment thread, executed by the simulation thread between two steps.
+		struct SimulationCommand
+		{
+			SimulationCommandType type = SimulationCommandType::CLEAN_UP_TRIAL;
+			double externalInputPosition = 0;
+			ElementDegeneracyType degeneracyType = ElementDegeneracyType::NONE;
+			std::string fieldToDegenerate{};
+			int trialIndex = 0;
+		};
+
+		// Centroids of both fields, published by the simulation thread after a step or a settle.
+		struct FieldCentroids
+		{
+			double inputFieldCentroid = -1;
+			double outputFieldCentroid = -1;
+			std::uint64_t simulationStep = 0;
+		};
+
+		struct SettlingStatistics
+		{
+			std::uint64_t numberOfSettles = 0;
+			std::uint64_t numberOfSteps = 0;
+			int maxNumberOfSteps = 0;
+
+			void add(const SettlingStatistics& other);
+			std::string toString() const;
 		};
 
 		class DnfcomposerHandlerInducing
 		{
 		private:
 			std::thread dnfcomposerThread;
-			std::thread readCentroidsThread;
 
 			std::unique_ptr<dnf_composer::Application> application;
 			std::shared_ptr<dnf_composer::Simulation> simulation;
@@ -51,19 +152,22 @@ namespace experiment
 
 			SimulationElements simulationElements;
 			SimulationParameters simulationParameters;
+			std::map<double, SimulationCheckpoint> settledStateCheckpoints;
+			std::shared_ptr<SettledStateStore> sharedSettledStates; // with the other workers, if any
 
 			int numberOfDegeneratedElements = 0;
 			int numberOfElementsToDegenerate = 0;
-
-			bool wasIntializationRequested = false;
-			bool wasExternalInputUpdated = false;
-			bool wasDegenerationRequested = false;
-			bool haveFieldsSettled = false;
-			bool hasTrialFinished = false;
-			bool hasExperimentFinished = false;
+			int trialIndex = 0;
+			std::uint64_t numberOfSimulationSteps = 0;
+			SettlingStatistics settlingStatistics;
+			std::vector<double> previousInputFieldActivation, previousOutputFieldActivation;
+
+			CommandChannel<SimulationCommand> commandChannel;
+			Seqlock<FieldCentroids> publishedCentroids;
+			std::atomic<bool> hasExperimentFinished = false;
 		public:
 			DnfcomposerHandlerInducing();
-			DnfcomposerHandlerInducing(bool isUserInterfaceActive);
+			DnfcomposerHandlerInducing(bool isUserInterfaceActive, bool isHeadless = false);
 
 			~DnfcomposerHandlerInducing() = default;
 
@@ -76,23 +180,55 @@ namespace experiment
 
 			void setDegeneracy(ElementDegeneracyType degeneracyType, const std::string& fieldToDegenerate);
 			void setExternalInput(const double& position);
-			void setHaveFieldsSettled(bool haveFieldsSettled);
+			void startTrial(int trialIndex);
+			void waitForPendingCommands();
 			void setIsUserInterfaceActiveAs(bool isUserInterfaceActive) const;
 
 			void setNumberOfElementsToDegenerate(int count);
+			void applyExperimentParameters(const ExperimentParameters& params);
+			void setSettledStateCache(bool isSettledStateCacheOn, bool reseedNoiseOnRestore);
+			void setSharedSettledStates(std::shared_ptr<SettledStateStore> sharedSettledStates);
+			void setAdaptiveSettling(bool isSettlingAdaptive, double tolerance, int stableSteps, int maxSteps);
+			void setDebugMode(bool isDebugMode);
+			void setFastSigmoid(bool isFastSigmoidOn);
+			void setSparseCouplingDensity(double density);
+			void setIncrementalCoupling(bool isIncrementalCouplingOn, double inputTolerance, int resyncSteps);
+			void setRandomSeed(std::uint64_t seed);
 
 			double getInputFieldCentroid() const;
 			double getOutputFieldCentroid() const;
-			bool getHaveFieldsSettled() const;
+			FieldCentroids getFieldCentroids() const;
+			CentroidHistory createOutputFieldCentroidHistory() const;
+			CommandLatencyStatistics getCommandLatencyStatistics() const;
+			bool isHeadless() const;
+			std::uint64_t getNumberOfSimulationSteps() const;
+			const SettlingStatistics& getSettlingStatistics() const;
 			std::shared_ptr<ExperimentWindow> getUserInterfaceWindow();
+			std::shared_ptr<dnf_composer::Simulation> getSimulation() const;
+			const SimulationParameters& getSimulationParameters() const;
+			std::shared_ptr<dnf_composer::element::GaussStimulus> createExternalInput(double position) const;
+
+			DegenerationThreshold findDegenerationThreshold(ElementDegeneracyType degeneracyType, const std::string& fieldToDegenerate,
+				double targetOutputFieldCentroid, double decisionTolerance);
 
-			void updateFieldCentroids();
 			void initializeFields();
 		private:
 			void setupUserInterface();
+			void submitCommand(SimulationCommand command);
+			void executeCommand(const SimulationCommand& command);
+			void seedTrial(int trialIndex);
+			void seedNoise();
+			void seedSettlingNoise();
 			void updateExternalInput();
+			bool restoreSettledState();
+			void captureSettledState();
+			SimulationCheckpoint createCheckpoint() const;
+			double settleWithFirstDegenerated(const SimulationCheckpoint& checkpoint, int count);
 			void activateDegeneration();
-			void waitForFieldsToSettle() const;
+			void waitForFieldsToSettle();
+			int settleAdaptively();
+			void stepSimulation();
+			void publishFieldCentroids();
 
 			void cleanUpTrial();
 		};
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <chrono>
 #include <thread>
+#include "ablation_scan.h"
+#include "async_results_writer.h"
 #include "experiment_parameters.h"
 #include "dnfc_handler_ind.h"
+#include "trial_scheduler.h"
 
 namespace experiment
 {
@@ -14,7 +18,10 @@ namespace experiment
 			double outputFieldCentroid = -1;
 			double targetInputFieldCentroid = -1;
 			double targetOutputFieldCentroid = -1;
-			std::vector<double> outputFieldCentroidHistory;
+			int trialIndex = 0;
+			CentroidHistory outputFieldCentroidHistory;
+			DegenerationThreshold degenerationThreshold;
+			AblationSensitivityMap ablationSensitivityMap;
 		};
 
 		class ExperimentHandlerInducing
@@ -25,6 +32,9 @@ namespace experiment
 
 			DnfcomposerHandlerInducing dnfcomposerHandler;
 			std::thread experimentThread;
+			std::uint64_t trialSchedulerSteps = 0;
+			SettlingStatistics trialSchedulerSettlingStatistics;
+			AsyncResultsWriter resultsWriter;
 
 
 			std::unordered_map<double, int> hueToAngleMap;
@@ -43,12 +53,28 @@ namespace experiment
 			void setExperimentAsEnded();
 			void setExperimentSetupData();
 
+			void runTrialsInSeries();
+			void runTrialsInParallel();
+
 			void setupProcedure();
 			void degenerationProcedure();
+			void thresholdProcedure();
+			void ablationScanProcedure();
 			void cleanUpTrial();
 
+			void waitFor(int milliseconds) const;
+			void logThroughput(double elapsedSeconds, std::uint64_t numberOfSteps) const;
+
 			bool hasOutputFieldDegenerated() const;
-			void saveOutputFieldCentroidToFile() const;
+			// Results are formatted here and written by resultsWriter on its own thread.
+			std::string getResultsFilename(const DegenerationParameters& degenerationParameters, double targetOutputFieldCentroid,
+				const std::string& suffix) const;
+			void saveOutputFieldCentroidToFile(const DegenerationParameters& degenerationParameters, double targetOutputFieldCentroid,
+				int trial, int trialIndex, const CentroidHistory& outputFieldCentroidHistory);
+			void saveDegenerationThresholdToFile(const DegenerationParameters& degenerationParameters, double targetOutputFieldCentroid,
+				const DegenerationThreshold& degenerationThreshold);
+			void saveAblationSensitivityMapToFile(const DegenerationParameters& degenerationParameters, double targetOutputFieldCentroid,
+				const AblationSensitivityMap& ablationSensitivityMap);
 
 			void readHueToAngleMap();
 		};
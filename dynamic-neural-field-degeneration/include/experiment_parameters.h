@@ -16,13 +16,35 @@ namespace experiment
 		int currentTrial = 0;
 		double decisionTolerance;
 		bool isDataSavingOn;
+		bool isBinaryResultsOn;
+		int resultsQueueCapacity;
 		bool isVisualizationOn;
 		bool isDebugModeOn;
+		bool isHeadlessModeOn;
+		int numberOfThreads;
+		int batchSize;
+		bool sweepAllDegeneracyTypes;
+		bool isSettledStateCacheOn;
+		bool reseedNoiseOnRestore;
+		bool isSettlingAdaptive;
+		double settlingTolerance;
+		int settlingStableSteps;
+		int maxTimeForFieldToSettle;
+		bool isThresholdModeOn;
+		bool isAblationScanOn;
+		bool isFastSigmoidOn;
+		double sparseCouplingDensity;
+		bool isIncrementalCouplingOn;
+		double incrementalCouplingTolerance;
+		int incrementalCouplingResyncSteps;
+		std::uint64_t randomSeed;
 
 		degeneration::DegenerationParameters degenerationParameters;
+		std::vector<degeneration::DegenerationParameters> degenerationSweep;
 
 		ExperimentParameters();
 		void read();
+		void setDegenerationSweep();
 		std::string toString() const;
 		void print() const;
 	};
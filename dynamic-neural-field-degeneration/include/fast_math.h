@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// exp(x) as 2^n * exp(f * ln2), with n = round(x * log2(e)) and |f| <= 0.5; the degree 8 Taylor
+		// polynomial keeps the relative error below 3e-10 (logistic sigmoid error below 1e-10).
+		// Arguments are clamped to +-1020 binary orders of magnitude instead of overflowing.
+		namespace fast_math
+		{
+			constexpr double log2e = 1.4426950408889634;
+			constexpr double ln2 = 0.6931471805599453;
+			constexpr double roundingShifter = 6755399441055744.0; // 1.5 * 2^52, rounds to an integer in the low mantissa bits
+			constexpr double maxExponent = 1020.0;
+			constexpr double coefficients[] = { 1.0 / 40320.0, 1.0 / 5040.0, 1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+
+			inline double exp(double x)
+			{
+				const double y = std::min(std::max(x * log2e, -maxExponent), maxExponent);
+				const double shifted = y + roundingShifter;
+				const double f = (y - (shifted - roundingShifter)) * ln2;
+
+				double polynomial = coefficients[0];
+				for (int k = 1; k < 9; k++)
+					polynomial = polynomial * f + coefficients[k];
+
+				const std::int64_t n = std::bit_cast<std::int64_t>(shifted) - std::bit_cast<std::int64_t>(roundingShifter);
+				return polynomial * std::bit_cast<double>((n + 1023) << 52);
+			}
+
+#if defined(__AVX2__)
+			inline __m256d exp(__m256d x)
+			{
+				const __m256d y = _mm256_min_pd(_mm256_max_pd(_mm256_mul_pd(x, _mm256_set1_pd(log2e)),
+					_mm256_set1_pd(-maxExponent)), _mm256_set1_pd(maxExponent));
+				const __m256d shifter = _mm256_set1_pd(roundingShifter);
+				const __m256d shifted = _mm256_add_pd(y, shifter);
+				const __m256d f = _mm256_mul_pd(_mm256_sub_pd(y, _mm256_sub_pd(shifted, shifter)), _mm256_set1_pd(ln2));
+
+				__m256d polynomial = _mm256_set1_pd(coefficients[0]);
+				for (int k = 1; k < 9; k++)
+					polynomial = _mm256_fmadd_pd(polynomial, f, _mm256_set1_pd(coefficients[k]));
+
+				const __m256i n = _mm256_sub_epi64(_mm256_castpd_si256(shifted), _mm256_castpd_si256(shifter));
+				const __m256i scale = _mm256_slli_epi64(_mm256_add_epi64(n, _mm256_set1_epi64x(1023)), 52);
+				return _mm256_mul_pd(polynomial, _mm256_castsi256_pd(scale));
+			}
+#endif
+		}
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <elements/gauss_kernel.h>
+
+#include "circular_convolution.h"
+
+// Drop-in replacement of a circular GaussKernel that convolves through a cached FFT of the kernel
+// once the field is large enough for O(M log M) to beat the O(N * kernel length) direct convolution.
+class FftGaussKernel : public dnf_composer::element::GaussKernel
+{
+public:
+	enum class ConvolutionMethod
+	{
+		AUTOMATIC,
+		DIRECT,
+		FFT
+	};
+private:
+	ConvolutionMethod requestedMethod = ConvolutionMethod::AUTOMATIC;
+	ConvolutionMethod method = ConvolutionMethod::DIRECT;
+	experiment::degeneration::CircularConvolution convolution;
+	std::vector<double>* input = nullptr;
+	std::vector<double>* output = nullptr;
+public:
+	FftGaussKernel(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
+		const dnf_composer::element::GaussKernelParameters& parameters);
+
+	void init() override;
+	void step(double t, double deltaT) override;
+
+	void setConvolutionMethod(ConvolutionMethod method);
+	ConvolutionMethod getConvolutionMethod() const;
+};
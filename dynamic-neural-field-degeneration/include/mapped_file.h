@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Read-only memory mapping of a whole file (CreateFileMapping on Windows, mmap elsewhere).
+		// The pages are shared with every other mapping of the file and are only read in when touched.
+		class MappedFile
+		{
+		private:
+			const unsigned char* data = nullptr;
+			std::size_t size = 0;
+			void* mapping = nullptr;
+		public:
+			MappedFile() = default;
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+			~MappedFile();
+
+			bool open(const std::string& filename);
+			void close();
+
+			bool isOpen() const;
+			const unsigned char* getData() const;
+			std::size_t getSize() const;
+		};
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+		// Block b of stream s under key k is a pure function philox(k, {b, s}), so every draw of a stream can be
+		// recomputed from (key, stream) alone and independent streams need no shared state.
+		class PhiloxGenerator
+		{
+		public:
+			using result_type = std::uint64_t;
+			using Block = std::array<std::uint64_t, 2>; // the four 32 bit words of a block, two per value
+		private:
+			std::uint64_t key = 0;
+			std::uint64_t stream = 0;
+			std::uint64_t blockCounter = 0;
+			Block buffer{};
+			int bufferPosition = 2; // 2 when the buffer is used up
+		public:
+			PhiloxGenerator();
+			PhiloxGenerator(std::uint64_t key, std::uint64_t stream);
+
+			void seed(std::uint64_t key, std::uint64_t stream);
+
+			result_type operator()();
+			static constexpr result_type min() { return 0; }
+			static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+			// Unbiased integer in [0, bound), uniform double in [0, 1) and [min, max).
+			std::uint64_t below(std::uint64_t bound);
+			double uniform();
+			double uniform(double min, double max);
+			// Standard normal samples (Box-Muller), two per block; the blocks are generated in batches.
+			// The AVX2 and scalar paths evaluate the same polynomials and philox.cpp is built without FP contraction,
+			// so a stream replays identically within a build.
+			void fillNormal(double* output, int count);
+
+			std::uint64_t getKey() const;
+			std::uint64_t getStream() const;
+
+			// Fresh key from std::random_device, for runs that are not meant to be replayed.
+			static std::uint64_t randomKey();
+			static Block generateBlock(std::uint64_t key, std::uint64_t stream, std::uint64_t blockIndex);
+		private:
+			static void generateBlocks(std::uint64_t key, std::uint64_t stream, std::uint64_t firstBlock, int count,
+				std::uint64_t* first, std::uint64_t* second);
+		};
+	}
+}
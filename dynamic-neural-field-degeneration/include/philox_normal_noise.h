@@ -0,0 +1,24 @@
+#pragma once
+
+#include <elements/normal_noise.h>
+
+#include "philox.h"
+
+// NormalNoise drawing its samples from a Philox stream, so the noise of a trial can be replayed
+// from (seed, stream). Unless setStream() is called, every element gets a fresh random key.
+class PhiloxNormalNoise : public dnf_composer::element::NormalNoise
+{
+private:
+	experiment::degeneration::PhiloxGenerator generator;
+	std::vector<double>* output = nullptr;
+public:
+	PhiloxNormalNoise(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
+		const dnf_composer::element::NormalNoiseParameters& parameters);
+
+	void init() override;
+	void step(double t, double deltaT) override;
+
+	// Restarts the noise at the first sample of the given stream.
+	void setStream(std::uint64_t seed, std::uint64_t stream);
+	double getAmplitude() const;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "centroid_history.h"
+#include "degeneration_parameters.h"
+#include "mapped_file.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		enum class ResultsSchema : std::uint32_t
+		{
+			CENTROID_HISTORY = 1
+		};
+
+		enum class ResultsValueType : std::uint32_t
+		{
+			CENTROID_CODEC = 1, // CentroidHistory encoding on the grid of the header
+			FLOAT32 = 4,
+			FLOAT64 = 8
+		};
+
+		// Binary results file ("<position> <name> - centroids.dnfr"), written in native (little-endian) byte order.
+		// A ResultsFileHeader is followed by one record per trial: a ResultsRecordHeader and its packed or
+		// encoded values, padded to 8 bytes. Records are only appended, so a file is readable after every
+		// trial and a record cut short by a crash is ignored by the reader.
+		struct ResultsFileHeader
+		{
+			char magic[8];
+			std::uint32_t version;
+			ResultsSchema schema;
+			ResultsValueType valueType;
+			ElementDegeneracyType degeneracyType;
+			double position; // target output field centroid
+			double stepSize; // grid of encoded centroids: d_x and number of neurons of the output field
+			std::uint32_t gridSize;
+			char name[52];
+		};
+
+		struct ResultsRecordHeader
+		{
+			std::uint32_t trial;
+			std::uint32_t trialIndex; // selects the random streams of the trial under the seed
+			std::uint64_t seed; // 0 for records converted from text
+			std::uint64_t numberOfValues;
+			std::uint64_t numberOfBytes; // before padding
+		};
+
+		static_assert(sizeof(ResultsFileHeader) == 96 && sizeof(ResultsRecordHeader) == 32, "results file layout changed");
+
+		ResultsFileHeader makeResultsFileHeader(ResultsSchema schema, ResultsValueType valueType, ElementDegeneracyType degeneracyType,
+			double position, const std::string& name, double stepSize = 0.0, int gridSize = 0);
+
+		// Flushes the stream and waits until its data is on disk.
+		bool syncFile(std::FILE* file);
+
+		// Keeps a results file open. Records are packed into a buffer and handed to the file with a single write.
+		class ResultsWriter
+		{
+		private:
+			std::FILE* file = nullptr;
+			std::string filename;
+			ResultsFileHeader header{};
+			std::vector<unsigned char> buffer; // packed records not yet written
+		public:
+			ResultsWriter() = default;
+			ResultsWriter(const ResultsWriter&) = delete;
+			ResultsWriter& operator=(const ResultsWriter&) = delete;
+			~ResultsWriter();
+
+			// Creates the file, or appends to it if it exists with the same header (besides the name).
+			bool open(const std::string& filename, const ResultsFileHeader& header);
+			void pack(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, const std::vector<double>& values);
+			void packEncoded(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, std::uint64_t numberOfValues,
+				const std::vector<std::uint8_t>& encodedValues);
+			bool write();
+			bool append(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, const std::vector<double>& values);
+			bool sync();
+			void close();
+			bool isOpen() const;
+			std::size_t getNumberOfPendingBytes() const;
+		};
+
+		// Memory-mapped view of a results file, with the record headers unpacked into columns.
+		class ResultsReader
+		{
+		private:
+			MappedFile file;
+			ResultsFileHeader header{};
+
+			std::vector<std::uint32_t> trials;
+			std::vector<std::uint32_t> trialIndices;
+			std::vector<std::uint64_t> seeds;
+			std::vector<std::uint64_t> numberOfValues;
+			std::vector<std::uint64_t> numberOfBytes;
+			std::vector<std::size_t> valueOffsets;
+		public:
+			ResultsReader() = default;
+			ResultsReader(const ResultsReader&) = delete;
+			ResultsReader& operator=(const ResultsReader&) = delete;
+			~ResultsReader();
+
+			bool open(const std::string& filename);
+			void close();
+
+			const ResultsFileHeader& getHeader() const;
+			std::size_t getNumberOfRecords() const;
+			const std::vector<std::uint32_t>& getTrials() const;
+			const std::vector<std::uint32_t>& getTrialIndices() const;
+			const std::vector<std::uint64_t>& getSeeds() const;
+			const std::vector<std::uint64_t>& getNumberOfValues() const;
+
+			// Values of a record in place, or nullptr if the file stores another value type.
+			const float* getFloatValues(std::size_t record) const;
+			const double* getDoubleValues(std::size_t record) const;
+			// Copies, widens or decodes the values of any value type.
+			bool copyValues(std::size_t record, std::vector<double>& values) const;
+		};
+
+		// Converters between the binary files and the text layout (one line of space-separated centroids
+		// per trial). The position and name are taken from the "<position> <name> - centroids" file name.
+		// Encoded files need the grid of the output field, and keep the six significant digits of the text.
+		bool convertTextToResults(const std::string& textFilename, const std::string& resultsFilename, ResultsValueType valueType,
+			double stepSize = 0.0, int gridSize = 0);
+		bool convertResultsToText(const std::string& resultsFilename, const std::string& textFilename);
+	}
+}
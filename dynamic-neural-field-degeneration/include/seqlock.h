@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Single-writer snapshot of a small trivially copyable value. The writer never blocks; readers
+		// never take a lock and retry only if they overlapped a publish, so they always see one whole snapshot.
+		template<typename T>
+		class Seqlock
+		{
+			static_assert(std::is_trivially_copyable_v<T>, "Seqlock values are copied word by word.");
+		private:
+			static constexpr size_t numberOfWords = (sizeof(T) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+			using Words = std::array<std::uint64_t, numberOfWords>;
+			using Bytes = std::array<unsigned char, sizeof(T)>; // the value as a trivial payload, see std::bit_cast
+
+			alignas(64) std::atomic<std::uint64_t> sequence = 0; // odd while a publish is in progress
+			std::array<std::atomic<std::uint64_t>, numberOfWords> words{};
+		public:
+			Seqlock()
+			{
+				publish(T{});
+			}
+
+			void publish(const T& value)
+			{
+				Words buffer{};
+				const Bytes bytes = std::bit_cast<Bytes>(value);
+				std::memcpy(buffer.data(), bytes.data(), sizeof(T));
+
+				const std::uint64_t current = sequence.load(std::memory_order_relaxed);
+				sequence.store(current + 1, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_release);
+				for (size_t i = 0; i < numberOfWords; i++)
+					words[i].store(buffer[i], std::memory_order_relaxed);
+				sequence.store(current + 2, std::memory_order_release);
+			}
+
+			T read() const
+			{
+				Words buffer;
+				std::uint64_t before, after;
+				do
+				{
+					before = sequence.load(std::memory_order_acquire);
+					for (size_t i = 0; i < numberOfWords; i++)
+						buffer[i] = words[i].load(std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_acquire);
+					after = sequence.load(std::memory_order_relaxed);
+				} while ((before & 1) != 0 || before != after);
+
+				Bytes bytes;
+				std::memcpy(bytes.data(), buffer.data(), sizeof(T));
+				return std::bit_cast<T>(bytes);
+			}
+		};
+	}
+}
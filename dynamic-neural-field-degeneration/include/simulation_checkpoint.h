@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <simulation/simulation.h>
+
+#include "degenerate_field_coupling.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Snapshot of the dynamic state of a simulation: the registered element components
+		// (field activations, kernel and coupling outputs, ...) and the coupling weights, i.e. the
+		// changes to the shared base weights unless they were materialized.
+		// Restoring copies the values back into the live buffers, without re-initializing elements.
+		class SimulationCheckpoint
+		{
+		private:
+			struct ComponentState
+			{
+				std::vector<double>* buffer;
+				std::vector<double> values;
+			};
+
+			std::vector<ComponentState> components;
+			std::shared_ptr<DegenerateFieldCoupling> fieldCoupling;
+			OverlayCouplingWeights couplingWeights;
+			bool captured = false;
+		public:
+			SimulationCheckpoint() = default;
+
+			void addComponent(const std::shared_ptr<dnf_composer::element::Element>& element, const std::string& componentName);
+			void addFieldCoupling(const std::shared_ptr<DegenerateFieldCoupling>& fieldCoupling);
+
+			void capture();
+			// Takes the captured values of a checkpoint of another simulation built with the same components.
+			void copyValuesFrom(const SimulationCheckpoint& other);
+			void restore() const;
+			bool isCaptured() const;
+		};
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "batched_simulation.h"
+#include "degeneration_order.h"
+#include "experiment_parameters.h"
+#include "dnfc_handler_ind.h"
+#include "philox.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		struct TrialWorkItem
+		{
+			DegenerationParameters degenerationParameters;
+			int trial = 0;
+			double targetInputFieldCentroid = -1;
+			double targetOutputFieldCentroid = -1;
+			int trialIndex = 0; // selects the random streams of the trial, see DnfcomposerHandlerInducing::startTrial
+		};
+
+		struct TrialResult
+		{
+			TrialWorkItem workItem;
+			CentroidHistory outputFieldCentroidHistory;
+			DegenerationThreshold threshold; // only set in threshold mode
+		};
+
+		// Runs independent (degeneracy type, trial, position) work items on a pool of worker threads.
+		// Every worker owns a private headless simulation; idle workers steal items from the back of
+		// the other workers' queues. Results are published in work item order, i.e. the order of a serial run.
+		// With a batch size above one, a worker runs its items on the lanes of a BatchedSimulation instead.
+		class TrialScheduler
+		{
+		public:
+			using ResultCallback = std::function<void(const TrialResult&)>;
+		private:
+			struct WorkQueue
+			{
+				std::mutex mutex;
+				std::deque<int> items;
+			};
+
+			// Trial in progress on a lane of a batched worker (workItemIndex is -1 on an idle lane).
+			struct BatchLane
+			{
+				int workItemIndex = -1;
+				int remainingSteps = 0;
+				bool isExternalInputOn = false;
+				TrialResult result;
+				DegenerationOrder degenerationOrder;
+				PhiloxGenerator weightValues;
+			};
+
+			const ExperimentParameters& params;
+			int numberOfWorkers;
+			std::vector<TrialWorkItem> workItems;
+			std::vector<std::unique_ptr<WorkQueue>> queues;
+			std::shared_ptr<SettledStateStore> settledStates; // settled state cache of all workers
+
+			std::mutex resultsMutex;
+			std::vector<std::optional<TrialResult>> pendingResults;
+			size_t nextResultToPublish = 0;
+			ResultCallback onResult;
+
+			std::atomic<std::uint64_t> numberOfSimulationSteps = 0;
+			std::mutex statisticsMutex;
+			SettlingStatistics settlingStatistics;
+		public:
+			TrialScheduler(const ExperimentParameters& params);
+
+			void addWorkItem(const TrialWorkItem& workItem);
+			void run(const ResultCallback& onResult);
+
+			int getNumberOfWorkers() const;
+			std::uint64_t getNumberOfSimulationSteps() const;
+			const SettlingStatistics& getSettlingStatistics() const;
+		private:
+			bool isBatched() const;
+			void work(int workerIndex);
+			void workBatched(int workerIndex, const DnfcomposerHandlerInducing& handler);
+			bool startLaneTrial(int workerIndex, const DnfcomposerHandlerInducing& handler, BatchedSimulation& batch, int lane, BatchLane& state);
+			void degenerateLane(const DegenerateFieldCoupling& coupling, BatchedSimulation& batch, int lane, BatchLane& state) const;
+			bool popWorkItem(int workerIndex, int& workItemIndex);
+			void publish(int workItemIndex, TrialResult&& result);
+
+			TrialResult runTrial(DnfcomposerHandlerInducing& handler, const TrialWorkItem& workItem) const;
+		};
+	}
+}
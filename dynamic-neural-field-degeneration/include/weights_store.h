@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "coupling_weights.h"
+#include "mapped_file.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		// Binary weight file ("<coupling name>_weights.dnfw"), written in native (little-endian) byte order.
+		// The header is followed by the rows of the weights in the layout of CouplingWeights (doubles,
+		// each row padded to the stride), so a mapping is used as it is. trainingChecksum identifies the
+		// coupling the weights were trained for, weightsChecksum the values, and sourceSize and
+		// sourceWriteTime the text weights file it was converted from.
+		struct WeightsFileHeader
+		{
+			char magic[8];
+			std::uint32_t version;
+			std::uint32_t valueSize; // bytes per weight, 8
+			std::uint32_t rows; // input (pre-synaptic) neurons
+			std::uint32_t cols; // output (post-synaptic) neurons
+			std::uint32_t stride; // doubles per row, with padding
+			std::uint32_t reserved;
+			std::uint64_t trainingChecksum;
+			std::uint64_t weightsChecksum;
+			std::uint64_t sourceSize; // bytes of the text weights file
+			std::int64_t sourceWriteTime; // its last write time, in ticks of std::filesystem::file_time_type
+			char name[64];
+		};
+
+		// Two cache lines, so the rows of a page-aligned mapping are 64-byte aligned like CouplingWeights.
+		static_assert(sizeof(WeightsFileHeader) == 128, "weights file layout changed");
+
+		// FNV-1a over 8-byte words (any tail is zero padded), chained through checksum.
+		std::uint64_t getChecksum(const void* data, std::size_t size, std::uint64_t checksum = 0xcbf29ce484222325ull);
+
+		// Memory-mapped weight file. The mapping is read-only and can be shared by the couplings of every
+		// simulation in the process, see mapWeightsFile and viewMappedWeights.
+		class MappedWeights
+		{
+		private:
+			MappedFile file;
+			WeightsFileHeader header{};
+		public:
+			MappedWeights() = default;
+
+			// Fails, without logging, if the file does not exist; logs if it exists but is not a valid
+			// weight file for rows x cols weights trained under trainingChecksum, or if the text weights
+			// file sourceFilename exists and was changed since the conversion.
+			bool open(const std::string& filename, int rows, int cols, std::uint64_t trainingChecksum, const std::string& sourceFilename);
+
+			const WeightsFileHeader& getHeader() const;
+			const double* row(int row) const;
+			void copyTo(CouplingWeights& weights) const;
+		};
+
+		// Maps a weight file once per process; later calls for the same file and shape return the same mapping.
+		// nullptr if there is no valid weight file, the caller then falls back to the text weights.
+		std::shared_ptr<const MappedWeights> mapWeightsFile(const std::string& filename, int rows, int cols, std::uint64_t trainingChecksum,
+			const std::string& sourceFilename);
+
+		// A read-only view of the mapped rows, which keeps the mapping alive: the couplings of every simulation
+		// use the pages of the file as their base, without a copy of the weights.
+		std::shared_ptr<const CouplingWeights> viewMappedWeights(std::shared_ptr<const MappedWeights> mappedWeights);
+
+		// The shared immutable copy of the given weights: simulations that read the same text weights get the
+		// same base for their OverlayCouplingWeights.
+		std::shared_ptr<const CouplingWeights> shareCouplingWeights(CouplingWeights&& weights);
+
+		// sourceFilename is the text weights file the weights were read from, recorded to detect later changes to it.
+		bool writeWeightsFile(const std::string& filename, const CouplingWeights& weights, std::uint64_t trainingChecksum, const std::string& name,
+			const std::string& sourceFilename);
+		// The text layout of dnf_composer::element::FieldCoupling: one line of space-separated weights per input neuron.
+		bool readTextWeights(const std::string& filename, CouplingWeights& weights);
+		bool convertTextToWeights(const std::string& textFilename, const std::string& weightsFilename, std::uint64_t trainingChecksum,
+			const std::string& name);
+	}
+}
@@ -0,0 +1,291 @@
+#include "ablation_scan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <elements/gauss_kernel.h>
+
+#include "degenerate_field_coupling.h"
+#include "degenerate_neural_field.h"
+#include "fast_math.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		AblationScan::AblationScan(const std::shared_ptr<dnf_composer::Simulation>& simulation, int numberOfSteps, int numberOfThreads)
+			: numberOfSteps(numberOfSteps),
+			numberOfThreads(numberOfThreads > 0 ? numberOfThreads : std::max(1, static_cast<int>(std::thread::hardware_concurrency())))
+		{
+			const auto outputField = std::dynamic_pointer_cast<DegenerateNeuralField>(simulation->getElement("output field"));
+			const DegenerateNeuralField::FusedDynamics dynamics = outputField->getFusedDynamics();
+			settledActivation = *outputField->getComponentPtr("activation");
+			settledOutput = *outputField->getComponentPtr("output");
+			restingLevel = *outputField->getComponentPtr("resting level");
+			size = static_cast<int>(settledActivation.size());
+			stepSize = outputField->getStepSize();
+			rate = simulation->getDeltaT() / dynamics.tau;
+			sigmoidXShift = dynamics.sigmoidXShift;
+			sigmoidSteepness = dynamics.sigmoidSteepness;
+			isFastSigmoidOn = dynamics.isFastSigmoidOn;
+
+			// Centered taps, merged on the circle, as in BatchedSimulation.
+			const auto kernel = std::dynamic_pointer_cast<dnf_composer::element::GaussKernel>(simulation->getElement("out - out"));
+			const std::vector<double>& values = *kernel->getComponentPtr("kernel");
+			settledKernelOutput = *kernel->getComponentPtr("output");
+			circular = kernel->getParameters().circular;
+			amplitudeGlobal = kernel->getParameters().amplitudeGlobal;
+			const int length = static_cast<int>(values.size());
+			const int range = length / 2;
+			std::map<int, double> taps;
+			for (int k = 0; k < length; k++)
+			{
+				const int offset = k - range;
+				taps[circular ? ((offset % size) + size) % size : offset] += values[k];
+			}
+			for (const auto& [offset, weight] : taps)
+			{
+				offsets.push_back(offset);
+				weights.push_back(weight);
+			}
+
+			const auto coupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(simulation->getElement("per - out"));
+			coupling->getCouplingWeights().copyTo(couplingWeights);
+			couplingScalar = coupling->getScalar();
+			presynapticActivation = *simulation->getElement("perceptual field")->getComponentPtr("activation");
+
+			heldInput = *coupling->getComponentPtr("output");
+			const std::vector<double>& noise = *simulation->getElement("noise kernel out")->getComponentPtr("output");
+			for (int i = 0; i < size; i++)
+				heldInput[i] += noise[i];
+		}
+
+		AblationSensitivityMap AblationScan::scan(AblationTarget target) const
+		{
+			AblationSensitivityMap map;
+			map.target = target;
+			map.rows = target == AblationTarget::WEIGHTS ? couplingWeights.getRows() : 1;
+			map.cols = getNumberOfElements(target) / map.rows;
+			map.outputFieldCentroids.assign(getNumberOfElements(target), -1.0);
+
+			const auto createLanes = [this]()
+				{
+					Lanes lanes;
+					const size_t length = static_cast<size_t>(size) * lanesPerBatch;
+					for (AlignedVector* values : { &lanes.activation, &lanes.output, &lanes.kernelOutput, &lanes.input, &lanes.aliveMask })
+						values->assign(length, 0.0);
+					lanes.sums.assign(lanesPerBatch, 0.0);
+					lanes.scratch.resize(size);
+					return lanes;
+				};
+
+			{
+				Lanes lanes = createLanes();
+				const int none = -1;
+				settleBatch(lanes, target, &none, 1, &map.baselineOutputFieldCentroid);
+			}
+
+			// Batches are handed out through a shared counter; every batch writes its own slice of the map.
+			const int numberOfElements = getNumberOfElements(target);
+			const int numberOfBatches = (numberOfElements + lanesPerBatch - 1) / lanesPerBatch;
+			std::atomic<int> nextBatch = 0;
+			const auto work = [&]()
+				{
+					Lanes lanes = createLanes();
+					int elements[lanesPerBatch];
+					for (int batch = nextBatch++; batch < numberOfBatches; batch = nextBatch++)
+					{
+						const int first = batch * lanesPerBatch;
+						const int count = std::min(lanesPerBatch, numberOfElements - first);
+						for (int lane = 0; lane < count; lane++)
+							elements[lane] = first + lane;
+						settleBatch(lanes, target, elements, count, map.outputFieldCentroids.data() + first);
+					}
+				};
+
+			std::vector<std::thread> workers;
+			for (int i = 1; i < std::min(numberOfThreads, numberOfBatches); i++)
+				workers.emplace_back(work);
+			work();
+			for (std::thread& worker : workers)
+				worker.join();
+			return map;
+		}
+
+		int AblationScan::getNumberOfElements(AblationTarget target) const
+		{
+			switch (target)
+			{
+			case AblationTarget::WEIGHTS:
+				return couplingWeights.getRows() * couplingWeights.getCols();
+			case AblationTarget::PRESYNAPTIC_NEURONS:
+				return couplingWeights.getRows();
+			case AblationTarget::POSTSYNAPTIC_NEURONS:
+				return size;
+			}
+			return 0;
+		}
+
+		void AblationScan::settleBatch(Lanes& lanes, AblationTarget target, const int* elements, int count, double* centroids) const
+		{
+			// Every lane starts from the settled state; lanes past count settle the baseline and are discarded.
+			for (int i = 0; i < size; i++)
+			{
+				const size_t row = static_cast<size_t>(i) * lanesPerBatch;
+				std::fill_n(lanes.activation.data() + row, lanesPerBatch, settledActivation[i]);
+				std::fill_n(lanes.output.data() + row, lanesPerBatch, settledOutput[i]);
+				std::fill_n(lanes.kernelOutput.data() + row, lanesPerBatch, settledKernelOutput[i]);
+				std::fill_n(lanes.input.data() + row, lanesPerBatch, heldInput[i]);
+				std::fill_n(lanes.aliveMask.data() + row, lanesPerBatch, 1.0);
+			}
+			for (int lane = 0; lane < count; lane++)
+				if (elements[lane] >= 0)
+					ablate(lanes, target, elements[lane], lane);
+
+			// Element order of Simulation::step: the field reads the kernel output of the previous step.
+			for (int step = 0; step < numberOfSteps; step++)
+			{
+				updateField(lanes);
+				convolve(lanes);
+			}
+
+			for (int lane = 0; lane < count; lane++)
+			{
+				for (int i = 0; i < size; i++)
+					lanes.scratch[i] = lanes.activation[static_cast<size_t>(i) * lanesPerBatch + lane];
+				centroids[lane] = DegenerateNeuralField::getCentroid(lanes.scratch.data(), size, stepSize);
+			}
+		}
+
+		void AblationScan::ablate(Lanes& lanes, AblationTarget target, int element, int lane) const
+		{
+			switch (target)
+			{
+			case AblationTarget::WEIGHTS:
+			{
+				const int row = element / couplingWeights.getCols();
+				const int col = element % couplingWeights.getCols();
+				lanes.input[static_cast<size_t>(col) * lanesPerBatch + lane] -= couplingScalar * couplingWeights(row, col) * presynapticActivation[row];
+				break;
+			}
+			case AblationTarget::PRESYNAPTIC_NEURONS:
+			{
+				const double* w = couplingWeights.row(element);
+				const double x = couplingScalar * presynapticActivation[element];
+				for (int col = 0; col < couplingWeights.getCols(); col++)
+					lanes.input[static_cast<size_t>(col) * lanesPerBatch + lane] -= x * w[col];
+				break;
+			}
+			case AblationTarget::POSTSYNAPTIC_NEURONS:
+				lanes.aliveMask[static_cast<size_t>(element) * lanesPerBatch + lane] = 0.0;
+				break;
+			}
+		}
+
+		void AblationScan::updateField(Lanes& lanes) const
+		{
+			// DegenerateNeuralField::calculateActivationAndOutput on every lane.
+			double* __restrict activation = lanes.activation.data();
+			double* __restrict output = lanes.output.data();
+			const double* __restrict mask = lanes.aliveMask.data();
+			const double* __restrict kernelOutput = lanes.kernelOutput.data();
+			const double* __restrict input = lanes.input.data();
+
+			for (int i = 0; i < size; i++)
+			{
+				const size_t row = static_cast<size_t>(i) * lanesPerBatch;
+				int lane = 0;
+#if defined(__AVX2__)
+				if (isFastSigmoidOn)
+				{
+					const __m256d rateVector = _mm256_set1_pd(rate);
+					const __m256d restingLevelVector = _mm256_set1_pd(restingLevel[i]);
+					const __m256d minusSteepness = _mm256_set1_pd(-sigmoidSteepness);
+					const __m256d xShift = _mm256_set1_pd(sigmoidXShift);
+					const __m256d one = _mm256_set1_pd(1.0);
+					for (; lane < lanesPerBatch; lane += 4)
+					{
+						const size_t k = row + lane;
+						const __m256d u = _mm256_load_pd(activation + k);
+						const __m256d drive = _mm256_add_pd(_mm256_sub_pd(restingLevelVector, u), _mm256_add_pd(_mm256_load_pd(kernelOutput + k), _mm256_load_pd(input + k)));
+						const __m256d updated = _mm256_mul_pd(_mm256_add_pd(u, _mm256_mul_pd(rateVector, drive)), _mm256_load_pd(mask + k));
+						_mm256_store_pd(activation + k, updated);
+						const __m256d e = fast_math::exp(_mm256_mul_pd(minusSteepness, _mm256_sub_pd(updated, xShift)));
+						_mm256_store_pd(output + k, _mm256_div_pd(one, _mm256_add_pd(one, e)));
+					}
+				}
+#endif
+				for (; lane < lanesPerBatch; lane++)
+				{
+					const size_t k = row + lane;
+					activation[k] = (activation[k] + rate * (-activation[k] + restingLevel[i] + kernelOutput[k] + input[k])) * mask[k];
+					const double exponent = -sigmoidSteepness * (activation[k] - sigmoidXShift);
+					output[k] = 1.0 / (1.0 + (isFastSigmoidOn ? fast_math::exp(exponent) : std::exp(exponent)));
+				}
+			}
+		}
+
+		void AblationScan::convolve(Lanes& lanes) const
+		{
+			// kernelOutput(i) = amplitudeGlobal * sum(output) + sum_t weight(t) * output(i - offset(t)); the
+			// lanes of a neuron stay in registers over all taps.
+			const int numberOfTaps = static_cast<int>(offsets.size());
+			const double* __restrict in = lanes.output.data();
+			double* __restrict out = lanes.kernelOutput.data();
+			double* __restrict sums = lanes.sums.data();
+
+			std::fill(lanes.sums.begin(), lanes.sums.end(), 0.0);
+			for (int i = 0; i < size; i++)
+				for (int lane = 0; lane < lanesPerBatch; lane++)
+					sums[lane] += in[static_cast<size_t>(i) * lanesPerBatch + lane];
+
+			for (int i = 0; i < size; i++)
+			{
+				double* target = out + static_cast<size_t>(i) * lanesPerBatch;
+#if defined(__AVX2__)
+				static_assert(lanesPerBatch == 16);
+				const __m256d global = _mm256_set1_pd(amplitudeGlobal);
+				__m256d acc0 = _mm256_mul_pd(global, _mm256_load_pd(sums));
+				__m256d acc1 = _mm256_mul_pd(global, _mm256_load_pd(sums + 4));
+				__m256d acc2 = _mm256_mul_pd(global, _mm256_load_pd(sums + 8));
+				__m256d acc3 = _mm256_mul_pd(global, _mm256_load_pd(sums + 12));
+#else
+				for (int lane = 0; lane < lanesPerBatch; lane++)
+					target[lane] = amplitudeGlobal * sums[lane];
+#endif
+				for (int t = 0; t < numberOfTaps; t++)
+				{
+					int j = i - offsets[t];
+					if (circular)
+						j += j < 0 ? size : 0;
+					else if (j < 0 || j >= size)
+						continue;
+
+					const double* source = in + static_cast<size_t>(j) * lanesPerBatch;
+#if defined(__AVX2__)
+					const __m256d w = _mm256_set1_pd(weights[t]);
+					acc0 = _mm256_fmadd_pd(w, _mm256_load_pd(source), acc0);
+					acc1 = _mm256_fmadd_pd(w, _mm256_load_pd(source + 4), acc1);
+					acc2 = _mm256_fmadd_pd(w, _mm256_load_pd(source + 8), acc2);
+					acc3 = _mm256_fmadd_pd(w, _mm256_load_pd(source + 12), acc3);
+#else
+					for (int lane = 0; lane < lanesPerBatch; lane++)
+						target[lane] += weights[t] * source[lane];
+#endif
+				}
+#if defined(__AVX2__)
+				_mm256_store_pd(target, acc0);
+				_mm256_store_pd(target + 4, acc1);
+				_mm256_store_pd(target + 8, acc2);
+				_mm256_store_pd(target + 12, acc3);
+#endif
+			}
+		}
+	}
+}
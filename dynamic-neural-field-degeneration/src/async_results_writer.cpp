@@ -0,0 +1,195 @@
+#include "async_results_writer.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		std::string ResultsWriterStatistics::toString() const
+		{
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(2);
+			stream << "Results writer: " << numberOfRecords << " records in " << numberOfWrites << " writes ("
+				<< static_cast<double>(numberOfBytes) / (1024.0 * 1024.0) << " MB), " << numberOfBlockedPushes << " pushes waited for a full queue.";
+			return stream.str();
+		}
+
+		AsyncResultsWriter::AsyncResultsWriter(std::size_t capacity)
+			: capacity(std::max<std::size_t>(capacity, 1))
+		{
+		}
+
+		AsyncResultsWriter::~AsyncResultsWriter()
+		{
+			close();
+		}
+
+		void AsyncResultsWriter::start()
+		{
+			if (thread.joinable())
+				return;
+			{
+				std::lock_guard lock(mutex);
+				isClosing = false;
+			}
+			thread = std::thread(&AsyncResultsWriter::run, this);
+		}
+
+		void AsyncResultsWriter::push(ResultsWriteRequest&& request)
+		{
+			std::unique_lock lock(mutex);
+			if (queue.size() >= capacity)
+			{
+				statistics.numberOfBlockedPushes++;
+				isNotFull.wait(lock, [this] { return queue.size() < capacity; });
+			}
+			queue.push_back(std::move(request));
+			lock.unlock();
+			isNotEmpty.notify_one();
+		}
+
+		void AsyncResultsWriter::close()
+		{
+			{
+				std::lock_guard lock(mutex);
+				isClosing = true;
+			}
+			isNotEmpty.notify_one();
+			if (thread.joinable())
+				thread.join();
+		}
+
+		ResultsWriterStatistics AsyncResultsWriter::getStatistics() const
+		{
+			std::lock_guard lock(mutex);
+			return statistics;
+		}
+
+		void AsyncResultsWriter::run()
+		{
+			std::vector<ResultsWriteRequest> requests;
+			while (true)
+			{
+				{
+					std::unique_lock lock(mutex);
+					isNotEmpty.wait(lock, [this] { return !queue.empty() || isClosing; });
+					if (queue.empty())
+						break;
+					requests.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+					queue.clear();
+				}
+				isNotFull.notify_all();
+
+				std::uint64_t numberOfWrites = 0;
+				const std::uint64_t numberOfBytes = write(requests, numberOfWrites);
+				{
+					std::lock_guard lock(mutex);
+					statistics.numberOfRecords += requests.size();
+					statistics.numberOfWrites += numberOfWrites;
+					statistics.numberOfBytes += numberOfBytes;
+				}
+				requests.clear();
+			}
+			closeFiles();
+		}
+
+		std::uint64_t AsyncResultsWriter::write(std::vector<ResultsWriteRequest>& requests, std::uint64_t& numberOfWrites)
+		{
+			// Records keep their order within a file; each file touched by the batch gets one write.
+			std::vector<ResultsWriter*> touchedResultsFiles;
+			std::vector<const std::string*> touchedTextFiles;
+			for (const auto& request : requests)
+			{
+				if (request.isBinary)
+				{
+					ResultsWriter* resultsFile = getResultsFile(request);
+					if (std::find(touchedResultsFiles.begin(), touchedResultsFiles.end(), resultsFile) == touchedResultsFiles.end())
+						touchedResultsFiles.push_back(resultsFile);
+					if (request.header.valueType == ResultsValueType::CENTROID_CODEC && !request.centroidHistory.empty())
+					{
+						request.centroidHistory.encode(encodedValues);
+						resultsFile->packEncoded(request.trial, request.trialIndex, request.seed, request.centroidHistory.size(), encodedValues);
+					}
+					else
+						resultsFile->pack(request.trial, request.trialIndex, request.seed, request.values);
+				}
+				else
+				{
+					if (std::find_if(touchedTextFiles.begin(), touchedTextFiles.end(),
+						[&](const std::string* filename) { return *filename == request.filename; }) == touchedTextFiles.end())
+						touchedTextFiles.push_back(&request.filename);
+					pendingText[request.filename] += request.text;
+				}
+			}
+
+			std::uint64_t numberOfBytes = 0;
+			for (ResultsWriter* resultsFile : touchedResultsFiles)
+			{
+				numberOfBytes += resultsFile->getNumberOfPendingBytes();
+				resultsFile->write();
+				numberOfWrites++;
+			}
+			for (const std::string* filename : touchedTextFiles)
+			{
+				std::string& text = pendingText[*filename];
+				std::FILE* file = getTextFile(*filename);
+				if (file && (std::fwrite(text.data(), 1, text.size(), file) != text.size() || std::fflush(file) != 0))
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to append to " + *filename + '.');
+				numberOfBytes += text.size();
+				numberOfWrites++;
+				text.clear();
+			}
+			return numberOfBytes;
+		}
+
+		ResultsWriter* AsyncResultsWriter::getResultsFile(const ResultsWriteRequest& request)
+		{
+			auto& resultsFile = resultsFiles[request.filename];
+			if (!resultsFile)
+			{
+				// A file that fails to open stays closed, and its records are dropped.
+				resultsFile = std::make_unique<ResultsWriter>();
+				resultsFile->open(request.filename, request.header);
+			}
+			return resultsFile.get();
+		}
+
+		std::FILE* AsyncResultsWriter::getTextFile(const std::string& filename)
+		{
+			const auto textFile = textFiles.find(filename);
+			if (textFile != textFiles.end())
+				return textFile->second;
+
+			std::FILE* file = std::fopen(filename.c_str(), "ab");
+			if (!file)
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to open the file for writing " + filename + '.');
+			textFiles[filename] = file;
+			return file;
+		}
+
+		void AsyncResultsWriter::closeFiles()
+		{
+			for (auto& [filename, resultsFile] : resultsFiles)
+			{
+				if (resultsFile->isOpen() && !resultsFile->sync())
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to sync " + filename + " to disk.");
+				resultsFile->close();
+			}
+			for (auto& [filename, file] : textFiles)
+			{
+				if (!file)
+					continue;
+				if (!syncFile(file))
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to sync " + filename + " to disk.");
+				std::fclose(file);
+			}
+			resultsFiles.clear();
+			textFiles.clear();
+			pendingText.clear();
+		}
+	}
+}
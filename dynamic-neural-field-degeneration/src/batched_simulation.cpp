@@ -0,0 +1,388 @@
+#include "batched_simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <elements/gauss_kernel.h>
+
+#include "degenerate_field_coupling.h"
+#include "degenerate_neural_field.h"
+#include "fast_math.h"
+#include "philox_normal_noise.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		BatchedSimulation::BatchedSimulation(const std::shared_ptr<dnf_composer::Simulation>& simulation, int batchSize)
+			: batchSize(batchSize), laneStride((batchSize + 3) / 4 * 4), deltaT(simulation->getDeltaT())
+		{
+			initializeField(perceptualField, simulation->getElement("perceptual field"));
+			initializeField(outputField, simulation->getElement("output field"));
+			initializeKernel(perceptualKernel, simulation->getElement("per - per"));
+			initializeKernel(outputKernel, simulation->getElement("out - out"));
+			initializeKernel(perceptualNoiseKernel, simulation->getElement("noise kernel per"));
+			initializeKernel(outputNoiseKernel, simulation->getElement("noise kernel out"));
+			initializeNoise(perceptualNoise, simulation->getElement("noise per"));
+			initializeNoise(outputNoise, simulation->getElement("noise out"));
+
+			const auto coupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(simulation->getElement("per - out"));
+			const OverlayCouplingWeights& couplingWeights = coupling->getCouplingWeights();
+			couplingRows = couplingWeights.getRows();
+			couplingCols = couplingWeights.getCols();
+			couplingScalar = coupling->getScalar();
+			initialWeights.resize(static_cast<size_t>(couplingRows) * couplingCols);
+			for (int col = 0; col < couplingCols; col++)
+				for (int row = 0; row < couplingRows; row++)
+					initialWeights[static_cast<size_t>(col) * couplingRows + row] = couplingWeights(row, col);
+			weights.assign(initialWeights.size() * laneStride, 0.0);
+			initialCouplingOutput = *coupling->getComponentPtr("output");
+			couplingOutput.assign(static_cast<size_t>(couplingCols) * laneStride, 0.0);
+
+			externalInput.assign(static_cast<size_t>(perceptualField.size) * laneStride, 0.0);
+			laneSums.assign(laneStride, 0.0);
+			laneScratch.resize(std::max(perceptualField.size, outputField.size));
+
+			for (int lane = 0; lane < batchSize; lane++)
+				resetLane(lane);
+		}
+
+		void BatchedSimulation::resetLane(int lane)
+		{
+			for (Field* field : { &perceptualField, &outputField })
+			{
+				setLane(field->activation, lane, field->initialActivation);
+				setLane(field->output, lane, field->initialOutput);
+				for (int i = 0; i < field->size; i++)
+					field->aliveMask[static_cast<size_t>(i) * laneStride + lane] = 1.0;
+			}
+			for (Kernel* kernel : { &perceptualKernel, &outputKernel, &perceptualNoiseKernel, &outputNoiseKernel })
+				setLane(kernel->output, lane, kernel->initialOutput);
+			setLane(couplingOutput, lane, initialCouplingOutput);
+			setLane(weights, lane, initialWeights);
+			setExternalInput(lane, {});
+
+			const auto isOfLane = [lane](const auto& pending) { return pending.lane == lane; };
+			std::erase_if(pendingPerceptualNeurons, isOfLane);
+			std::erase_if(pendingOutputNeurons, isOfLane);
+			std::erase_if(pendingWeights, isOfLane);
+		}
+
+		void BatchedSimulation::setExternalInput(int lane, const std::vector<double>& input)
+		{
+			if (input.empty())
+			{
+				for (int i = 0; i < perceptualField.size; i++)
+					externalInput[static_cast<size_t>(i) * laneStride + lane] = 0.0;
+				return;
+			}
+			setLane(externalInput, lane, input);
+		}
+
+		void BatchedSimulation::setNoiseStreams(int lane, std::uint64_t seed, std::uint64_t perceptualStream, std::uint64_t outputStream)
+		{
+			perceptualNoise.generators[lane].seed(seed, perceptualStream);
+			outputNoise.generators[lane].seed(seed, outputStream);
+		}
+
+		void BatchedSimulation::deactivateNeuron(int lane, BatchedField field, int index)
+		{
+			(field == BatchedField::PERCEPTUAL ? pendingPerceptualNeurons : pendingOutputNeurons).push_back({ lane, index });
+		}
+
+		void BatchedSimulation::setWeight(int lane, int row, int col, double value)
+		{
+			pendingWeights.push_back({ lane, row, col, value });
+		}
+
+		double BatchedSimulation::getWeight(int lane, int row, int col) const
+		{
+			return weights[(static_cast<size_t>(col) * couplingRows + row) * laneStride + lane];
+		}
+
+		void BatchedSimulation::step()
+		{
+			// Element order of getExperimentSimulation(): the fields read the kernel, noise and coupling
+			// outputs of the previous step, the kernels and the coupling read the fields of this step.
+			updateField(perceptualField, perceptualKernel.output, perceptualNoiseKernel.output, externalInput);
+			applyPendingNeurons(perceptualField, pendingPerceptualNeurons);
+			updateField(outputField, outputKernel.output, outputNoiseKernel.output, couplingOutput);
+			applyPendingNeurons(outputField, pendingOutputNeurons);
+			convolve(perceptualKernel, perceptualField.output);
+			convolve(outputKernel, outputField.output);
+			multiplyCoupling();
+			applyPendingWeights();
+			generateNoise(perceptualNoise);
+			generateNoise(outputNoise);
+			convolve(perceptualNoiseKernel, perceptualNoise.output);
+			convolve(outputNoiseKernel, outputNoise.output);
+			numberOfSteps++;
+		}
+
+		double BatchedSimulation::getCentroid(int lane, BatchedField field)
+		{
+			const Field& source = getField(field);
+			for (int i = 0; i < source.size; i++)
+				laneScratch[i] = source.activation[static_cast<size_t>(i) * laneStride + lane];
+			return DegenerateNeuralField::getCentroid(laneScratch.data(), source.size, source.stepSize);
+		}
+
+		int BatchedSimulation::getBatchSize() const
+		{
+			return batchSize;
+		}
+
+		int BatchedSimulation::getFieldSize(BatchedField field) const
+		{
+			return field == BatchedField::PERCEPTUAL ? perceptualField.size : outputField.size;
+		}
+
+		int BatchedSimulation::getCouplingRows() const
+		{
+			return couplingRows;
+		}
+
+		int BatchedSimulation::getCouplingCols() const
+		{
+			return couplingCols;
+		}
+
+		std::uint64_t BatchedSimulation::getNumberOfSteps() const
+		{
+			return numberOfSteps;
+		}
+
+		void BatchedSimulation::initializeField(Field& field, const std::shared_ptr<dnf_composer::element::Element>& element)
+		{
+			const auto neuralField = std::dynamic_pointer_cast<DegenerateNeuralField>(element);
+			const DegenerateNeuralField::FusedDynamics dynamics = neuralField->getFusedDynamics();
+			field.initialActivation = *neuralField->getComponentPtr("activation");
+			field.initialOutput = *neuralField->getComponentPtr("output");
+			field.restingLevel = *neuralField->getComponentPtr("resting level");
+			field.size = static_cast<int>(field.initialActivation.size());
+			field.stepSize = neuralField->getStepSize();
+			field.rate = deltaT / dynamics.tau;
+			field.sigmoidXShift = dynamics.sigmoidXShift;
+			field.sigmoidSteepness = dynamics.sigmoidSteepness;
+			field.isFastSigmoidOn = dynamics.isFastSigmoidOn;
+
+			const size_t size = static_cast<size_t>(field.size) * laneStride;
+			field.activation.assign(size, 0.0);
+			field.output.assign(size, 0.0);
+			field.aliveMask.assign(size, 0.0);
+		}
+
+		void BatchedSimulation::initializeKernel(Kernel& kernel, const std::shared_ptr<dnf_composer::element::Element>& element)
+		{
+			const auto gaussKernel = std::dynamic_pointer_cast<dnf_composer::element::GaussKernel>(element);
+			const std::vector<double>& values = *gaussKernel->getComponentPtr("kernel");
+			kernel.initialOutput = *gaussKernel->getComponentPtr("output");
+			kernel.size = static_cast<int>(kernel.initialOutput.size());
+			kernel.circular = gaussKernel->getParameters().circular;
+			kernel.amplitudeGlobal = gaussKernel->getParameters().amplitudeGlobal;
+
+			// Centered taps, as in FftGaussKernel; on a circular kernel offsets that meet on the circle are merged.
+			const int length = static_cast<int>(values.size());
+			const int range = length / 2;
+			if (length % 2 == 0)
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::LogLevel::ERROR,
+					"Kernel " + gaussKernel->getUniqueName() + " has an even length, its taps are centered on element " + std::to_string(range));
+
+			std::map<int, double> taps;
+			for (int k = 0; k < length; k++)
+			{
+				const int offset = k - range;
+				taps[kernel.circular ? ((offset % kernel.size) + kernel.size) % kernel.size : offset] += values[k];
+			}
+			for (const auto& [offset, weight] : taps)
+			{
+				kernel.offsets.push_back(offset);
+				kernel.weights.push_back(weight);
+			}
+
+			kernel.output.assign(static_cast<size_t>(kernel.size) * laneStride, 0.0);
+		}
+
+		void BatchedSimulation::initializeNoise(Noise& noise, const std::shared_ptr<dnf_composer::element::Element>& element)
+		{
+			const auto normalNoise = std::dynamic_pointer_cast<PhiloxNormalNoise>(element);
+			noise.size = static_cast<int>(normalNoise->getComponentPtr("output")->size());
+			noise.scale = normalNoise->getAmplitude() / std::sqrt(deltaT);
+			noise.generators.resize(batchSize);
+			noise.output.assign(static_cast<size_t>(noise.size) * laneStride, 0.0);
+		}
+
+		void BatchedSimulation::updateField(Field& field, const AlignedVector& input0, const AlignedVector& input1, const AlignedVector& input2)
+		{
+			// DegenerateNeuralField::calculateActivationAndOutput on every lane; the inputs are summed in place of updateInput().
+			double* __restrict activation = field.activation.data();
+			double* __restrict output = field.output.data();
+			const double* __restrict mask = field.aliveMask.data();
+			const double* __restrict a = input0.data();
+			const double* __restrict b = input1.data();
+			const double* __restrict c = input2.data();
+			const double rate = field.rate;
+
+			for (int i = 0; i < field.size; i++)
+			{
+				const size_t row = static_cast<size_t>(i) * laneStride;
+				const double restingLevel = field.restingLevel[i];
+				int lane = 0;
+#if defined(__AVX2__)
+				if (field.isFastSigmoidOn)
+				{
+					const __m256d rateVector = _mm256_set1_pd(rate);
+					const __m256d restingLevelVector = _mm256_set1_pd(restingLevel);
+					const __m256d minusSteepness = _mm256_set1_pd(-field.sigmoidSteepness);
+					const __m256d xShift = _mm256_set1_pd(field.sigmoidXShift);
+					const __m256d one = _mm256_set1_pd(1.0);
+					for (; lane < laneStride; lane += 4)
+					{
+						const size_t k = row + lane;
+						const __m256d input = _mm256_add_pd(_mm256_add_pd(_mm256_load_pd(a + k), _mm256_load_pd(b + k)), _mm256_load_pd(c + k));
+						const __m256d u = _mm256_load_pd(activation + k);
+						const __m256d drive = _mm256_add_pd(_mm256_sub_pd(restingLevelVector, u), input);
+						const __m256d updated = _mm256_mul_pd(_mm256_add_pd(u, _mm256_mul_pd(rateVector, drive)), _mm256_load_pd(mask + k));
+						_mm256_store_pd(activation + k, updated);
+						const __m256d e = fast_math::exp(_mm256_mul_pd(minusSteepness, _mm256_sub_pd(updated, xShift)));
+						_mm256_store_pd(output + k, _mm256_div_pd(one, _mm256_add_pd(one, e)));
+					}
+				}
+#endif
+				for (; lane < laneStride; lane++)
+				{
+					const size_t k = row + lane;
+					const double input = a[k] + b[k] + c[k];
+					activation[k] = (activation[k] + rate * (-activation[k] + restingLevel + input)) * mask[k];
+					const double exponent = -field.sigmoidSteepness * (activation[k] - field.sigmoidXShift);
+					output[k] = 1.0 / (1.0 + (field.isFastSigmoidOn ? fast_math::exp(exponent) : std::exp(exponent)));
+				}
+			}
+		}
+
+		void BatchedSimulation::convolve(Kernel& kernel, const AlignedVector& input)
+		{
+			const int size = kernel.size;
+			const int numberOfTaps = static_cast<int>(kernel.offsets.size());
+			const double* __restrict in = input.data();
+			double* __restrict out = kernel.output.data();
+			double* __restrict sums = laneSums.data();
+
+			std::fill(laneSums.begin(), laneSums.end(), 0.0);
+			for (int i = 0; i < size; i++)
+				for (int lane = 0; lane < laneStride; lane++)
+					sums[lane] += in[static_cast<size_t>(i) * laneStride + lane];
+
+			for (int i = 0; i < size; i++)
+			{
+				double* target = out + static_cast<size_t>(i) * laneStride;
+				for (int lane = 0; lane < laneStride; lane++)
+					target[lane] = kernel.amplitudeGlobal * sums[lane];
+
+				for (int t = 0; t < numberOfTaps; t++)
+				{
+					int j = i - kernel.offsets[t];
+					if (kernel.circular)
+						j += j < 0 ? size : 0;
+					else if (j < 0 || j >= size)
+						continue;
+
+					const double* source = in + static_cast<size_t>(j) * laneStride;
+					const double weight = kernel.weights[t];
+					int lane = 0;
+#if defined(__AVX2__)
+					const __m256d w = _mm256_set1_pd(weight);
+					for (; lane < laneStride; lane += 4)
+						_mm256_store_pd(target + lane, _mm256_fmadd_pd(w, _mm256_load_pd(source + lane), _mm256_load_pd(target + lane)));
+#endif
+					for (; lane < laneStride; lane++)
+						target[lane] += weight * source[lane];
+				}
+			}
+		}
+
+		void BatchedSimulation::multiplyCoupling()
+		{
+			// couplingOutput(col) = scalar * sum_row weights(row, col) * perceptual activation(row), as in
+			// CouplingWeights::multiplyTransposed; each lane's weights of a column are contiguous over the rows.
+			const double* __restrict activation = perceptualField.activation.data();
+			double* __restrict out = couplingOutput.data();
+
+			for (int col = 0; col < couplingCols; col++)
+			{
+				const double* __restrict w = weights.data() + static_cast<size_t>(col) * couplingRows * laneStride;
+				double* target = out + static_cast<size_t>(col) * laneStride;
+				int lane = 0;
+#if defined(__AVX2__)
+				for (; lane < laneStride; lane += 4)
+				{
+					__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+					int row = 0;
+					for (; row + 2 <= couplingRows; row += 2)
+					{
+						const size_t k = static_cast<size_t>(row) * laneStride + lane;
+						acc0 = _mm256_fmadd_pd(_mm256_load_pd(w + k), _mm256_load_pd(activation + k), acc0);
+						acc1 = _mm256_fmadd_pd(_mm256_load_pd(w + k + laneStride), _mm256_load_pd(activation + k + laneStride), acc1);
+					}
+					for (; row < couplingRows; row++)
+					{
+						const size_t k = static_cast<size_t>(row) * laneStride + lane;
+						acc0 = _mm256_fmadd_pd(_mm256_load_pd(w + k), _mm256_load_pd(activation + k), acc0);
+					}
+					_mm256_store_pd(target + lane, _mm256_mul_pd(_mm256_add_pd(acc0, acc1), _mm256_set1_pd(couplingScalar)));
+				}
+#endif
+				for (; lane < laneStride; lane++)
+				{
+					double sum = 0.0;
+					for (int row = 0; row < couplingRows; row++)
+					{
+						const size_t k = static_cast<size_t>(row) * laneStride + lane;
+						sum += w[k] * activation[k];
+					}
+					target[lane] = couplingScalar * sum;
+				}
+			}
+		}
+
+		void BatchedSimulation::generateNoise(Noise& noise)
+		{
+			// Each lane draws the samples its own PhiloxNormalNoise would, and scatters them into its column.
+			for (int lane = 0; lane < batchSize; lane++)
+			{
+				noise.generators[lane].fillNormal(laneScratch.data(), noise.size);
+				for (int i = 0; i < noise.size; i++)
+					noise.output[static_cast<size_t>(i) * laneStride + lane] = laneScratch[i] * noise.scale;
+			}
+		}
+
+		void BatchedSimulation::applyPendingNeurons(Field& field, std::vector<PendingNeuron>& pending)
+		{
+			for (const PendingNeuron& neuron : pending)
+				field.aliveMask[static_cast<size_t>(neuron.index) * laneStride + neuron.lane] = 0.0;
+			pending.clear();
+		}
+
+		void BatchedSimulation::applyPendingWeights()
+		{
+			for (const PendingWeight& weight : pendingWeights)
+				weights[(static_cast<size_t>(weight.col) * couplingRows + weight.row) * laneStride + weight.lane] = weight.value;
+			pendingWeights.clear();
+		}
+
+		BatchedSimulation::Field& BatchedSimulation::getField(BatchedField field)
+		{
+			return field == BatchedField::PERCEPTUAL ? perceptualField : outputField;
+		}
+
+		void BatchedSimulation::setLane(AlignedVector& values, int lane, const std::vector<double>& source) const
+		{
+			for (size_t i = 0; i < source.size(); i++)
+				values[i * laneStride + lane] = source[i];
+		}
+	}
+}
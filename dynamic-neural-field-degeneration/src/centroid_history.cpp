@@ -0,0 +1,313 @@
+#include "centroid_history.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		namespace
+		{
+			enum RunKind : std::uint8_t
+			{
+				GRID = 0,
+				HALF = 1,
+				FRACTION = 2,
+				SPECIAL = 3
+			};
+
+			enum SpecialValue : std::uint8_t
+			{
+				NO_PEAK = 0,
+				LITERAL = 1
+			};
+
+			constexpr std::uint64_t fieldEscape = 7;
+			constexpr double noPeakCentroid = -1.0;
+
+			void putVarint(std::vector<std::uint8_t>& encoded, std::uint64_t value)
+			{
+				while (value >= 0x80)
+				{
+					encoded.push_back(static_cast<std::uint8_t>(value | 0x80));
+					value >>= 7;
+				}
+				encoded.push_back(static_cast<std::uint8_t>(value));
+			}
+
+			bool getVarint(const std::uint8_t*& cursor, const std::uint8_t* end, std::uint64_t& value)
+			{
+				value = 0;
+				for (int shift = 0; cursor < end && shift < 64; shift += 7)
+				{
+					const std::uint8_t byte = *cursor++;
+					value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+					if (!(byte & 0x80))
+						return true;
+				}
+				return false;
+			}
+
+			std::uint64_t zigzag(std::int64_t value)
+			{
+				return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+			}
+
+			std::int64_t unzigzag(std::uint64_t value)
+			{
+				return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+			}
+
+			// The decoder evaluates exactly this expression, so the encoder can test its candidates with it.
+			double getCentroid(double stepSize, std::int64_t gridIndex, std::uint64_t numerator, std::uint64_t denominator)
+			{
+				return stepSize * (static_cast<double>(gridIndex) + static_cast<double>(numerator) / static_cast<double>(denominator));
+			}
+
+			// Single precision, or within half a unit of the last of significantDigits digits (so that the
+			// decoded centroid prints as the same text).
+			bool isEqualAtRecordedPrecision(double decoded, double centroid, int significantDigits)
+			{
+				if (significantDigits <= 0)
+					return static_cast<float>(decoded) == static_cast<float>(centroid);
+				if (centroid == 0.0)
+					return decoded == 0.0;
+				const double unit = std::pow(10.0, std::floor(std::log10(std::fabs(centroid))) - significantDigits + 1);
+				return std::fabs(decoded - centroid) < 0.5 * unit;
+			}
+
+			// Smallest fraction of the grid (denominators 1, 2, the previous one, then up to maxDenominator)
+			// that decodes to the centroid.
+			bool findFraction(double centroid, double stepSize, int maxDenominator, int previousDenominator, int significantDigits,
+				std::int64_t& gridIndex, std::uint64_t& numerator, std::uint64_t& denominator)
+			{
+				if (!(stepSize > 0.0) || !std::isfinite(centroid))
+					return false;
+				const double position = centroid / stepSize;
+				if (std::fabs(position) > 9.0e15)
+					return false;
+				const double floorPosition = std::floor(position);
+				const double fraction = position - floorPosition;
+
+				const auto isFraction = [&](int candidate)
+					{
+						gridIndex = static_cast<std::int64_t>(floorPosition);
+						numerator = static_cast<std::uint64_t>(std::llround(fraction * candidate));
+						denominator = static_cast<std::uint64_t>(candidate);
+						if (numerator == denominator)
+						{
+							gridIndex++;
+							numerator = 0;
+						}
+						return isEqualAtRecordedPrecision(getCentroid(stepSize, gridIndex, numerator, denominator), centroid, significantDigits);
+					};
+
+				if (isFraction(1) || isFraction(2))
+					return true;
+				if (previousDenominator > 2 && previousDenominator <= maxDenominator && isFraction(previousDenominator))
+					return true;
+				for (int candidate = 3; candidate <= maxDenominator; candidate++)
+					if (candidate != previousDenominator && isFraction(candidate))
+						return true;
+				return false;
+			}
+		}
+
+		CentroidHistory::CentroidHistory(double stepSize, int maxDenominator)
+			: stepSize(stepSize), maxDenominator(maxDenominator)
+		{
+		}
+
+		void CentroidHistory::setGrid(double stepSize, int maxDenominator)
+		{
+			clear();
+			this->stepSize = stepSize;
+			this->maxDenominator = maxDenominator;
+		}
+
+		void CentroidHistory::push_back(double centroid)
+		{
+			numberOfValues++;
+			if (runLength > 0 && centroid == runValue)
+			{
+				runLength++;
+				return;
+			}
+			if (runLength > 0)
+				appendRun(bytes, state, runValue, runLength, stepSize, maxDenominator);
+			runValue = centroid;
+			runLength = 1;
+		}
+
+		void CentroidHistory::clear()
+		{
+			bytes.clear();
+			state = EncoderState();
+			runLength = 0;
+			numberOfValues = 0;
+		}
+
+		std::size_t CentroidHistory::size() const
+		{
+			return numberOfValues;
+		}
+
+		bool CentroidHistory::empty() const
+		{
+			return numberOfValues == 0;
+		}
+
+		double CentroidHistory::getStepSize() const
+		{
+			return stepSize;
+		}
+
+		int CentroidHistory::getMaxDenominator() const
+		{
+			return maxDenominator;
+		}
+
+		std::size_t CentroidHistory::getNumberOfBytes() const
+		{
+			return bytes.size();
+		}
+
+		void CentroidHistory::encode(std::vector<std::uint8_t>& encoded) const
+		{
+			encoded = bytes;
+			if (runLength > 0)
+			{
+				EncoderState runState = state;
+				appendRun(encoded, runState, runValue, runLength, stepSize, maxDenominator);
+			}
+		}
+
+		void CentroidHistory::decode(std::vector<double>& centroids) const
+		{
+			std::vector<std::uint8_t> encoded;
+			encode(encoded);
+			decode(encoded.data(), encoded.size(), numberOfValues, stepSize, centroids);
+		}
+
+		void CentroidHistory::encode(const double* centroids, std::size_t count, double stepSize, int maxDenominator,
+			std::vector<std::uint8_t>& encoded, int significantDigits)
+		{
+			encoded.clear();
+			EncoderState state;
+			for (std::size_t i = 0; i < count;)
+			{
+				std::size_t end = i + 1;
+				while (end < count && centroids[end] == centroids[i])
+					end++;
+				appendRun(encoded, state, centroids[i], end - i, stepSize, maxDenominator, significantDigits);
+				i = end;
+			}
+		}
+
+		bool CentroidHistory::decode(const std::uint8_t* encoded, std::size_t numberOfBytes, std::size_t numberOfValues, double stepSize,
+			std::vector<double>& centroids)
+		{
+			centroids.clear();
+			const std::uint8_t* cursor = encoded;
+			const std::uint8_t* end = encoded + numberOfBytes;
+			std::int64_t gridIndex = 0;
+			while (cursor < end)
+			{
+				const std::uint8_t token = *cursor++;
+				const std::uint8_t kind = token >> 6;
+				std::uint64_t gridChange = (token >> 3) & fieldEscape;
+				std::uint64_t length = token & fieldEscape;
+				std::uint64_t escaped = 0;
+
+				if (length == fieldEscape)
+				{
+					if (!getVarint(cursor, end, escaped))
+						return false;
+					length += escaped;
+				}
+				length++;
+				if (gridChange == fieldEscape)
+				{
+					if (!getVarint(cursor, end, escaped))
+						return false;
+					gridChange += escaped;
+				}
+
+				double centroid = noPeakCentroid;
+				if (kind == SPECIAL)
+				{
+					if (cursor == end)
+						return false;
+					if (*cursor++ == LITERAL)
+					{
+						float literal;
+						if (end - cursor < static_cast<std::ptrdiff_t>(sizeof(literal)))
+							return false;
+						std::memcpy(&literal, cursor, sizeof(literal));
+						cursor += sizeof(literal);
+						centroid = literal;
+					}
+				}
+				else
+				{
+					gridIndex += unzigzag(gridChange);
+					std::uint64_t numerator = kind == HALF ? 1 : 0;
+					std::uint64_t denominator = kind == HALF ? 2 : 1;
+					if (kind == FRACTION && (!getVarint(cursor, end, denominator) || !getVarint(cursor, end, numerator) || denominator == 0))
+						return false;
+					centroid = getCentroid(stepSize, gridIndex, numerator, denominator);
+				}
+				// The run length comes from the file: it may not go past the values the record declares.
+				if (length > numberOfValues - centroids.size())
+					return false;
+				centroids.insert(centroids.end(), length, centroid);
+			}
+			return centroids.size() == numberOfValues;
+		}
+
+		void CentroidHistory::appendRun(std::vector<std::uint8_t>& encoded, EncoderState& state, double value, std::uint64_t length,
+			double stepSize, int maxDenominator, int significantDigits)
+		{
+			std::uint8_t kind = SPECIAL;
+			std::uint8_t special = value == noPeakCentroid ? NO_PEAK : LITERAL;
+			std::int64_t gridIndex = state.gridIndex;
+			std::int64_t fractionGridIndex = 0;
+			std::uint64_t numerator = 0, denominator = 1;
+			if (special == LITERAL && findFraction(value, stepSize, maxDenominator, state.denominator, significantDigits, fractionGridIndex, numerator, denominator))
+			{
+				gridIndex = fractionGridIndex;
+				kind = numerator == 0 ? GRID : (denominator == 2 ? HALF : FRACTION);
+				if (kind == FRACTION)
+					state.denominator = static_cast<int>(denominator);
+			}
+
+			const std::uint64_t gridChange = zigzag(gridIndex - state.gridIndex);
+			state.gridIndex = gridIndex;
+			const std::uint64_t lengthField = length - 1;
+			encoded.push_back(static_cast<std::uint8_t>((kind << 6) | (std::min(gridChange, fieldEscape) << 3) | std::min(lengthField, fieldEscape)));
+			if (lengthField >= fieldEscape)
+				putVarint(encoded, lengthField - fieldEscape);
+			if (gridChange >= fieldEscape)
+				putVarint(encoded, gridChange - fieldEscape);
+
+			if (kind == FRACTION)
+			{
+				putVarint(encoded, denominator);
+				putVarint(encoded, numerator);
+			}
+			else if (kind == SPECIAL)
+			{
+				encoded.push_back(special);
+				if (special == LITERAL)
+				{
+					const float literal = static_cast<float>(value);
+					const std::size_t offset = encoded.size();
+					encoded.resize(offset + sizeof(literal));
+					std::memcpy(encoded.data() + offset, &literal, sizeof(literal));
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,116 @@
+#include "circular_convolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <utility>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		namespace
+		{
+			int nextPowerOfTwo(int value)
+			{
+				int power = 1;
+				while (power < value)
+					power <<= 1;
+				return power;
+			}
+
+			// Plain complex product; operator* handles infinities and NaNs (a library call unless -ffast-math).
+			inline std::complex<double> multiply(const std::complex<double>& a, const std::complex<double>& b)
+			{
+				return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+			}
+		}
+
+		void CircularConvolution::setKernel(const std::vector<double>& circularKernel)
+		{
+			size = static_cast<int>(circularKernel.size());
+			transformSize = nextPowerOfTwo(2 * size - 1);
+
+			int numberOfBits = 0;
+			while ((1 << numberOfBits) < transformSize)
+				numberOfBits++;
+			bitReversal.assign(transformSize, 0);
+			for (int i = 0; i < transformSize; i++)
+				for (int bit = 0; bit < numberOfBits; bit++)
+					if (i & (1 << bit))
+						bitReversal[i] |= 1 << (numberOfBits - 1 - bit);
+
+			twiddles.resize(transformSize / 2);
+			for (int k = 0; k < transformSize / 2; k++)
+				twiddles[k] = std::polar(1.0, -2.0 * std::numbers::pi * k / transformSize);
+
+			kernelSpectrum.assign(transformSize, 0.0);
+			for (int i = 0; i < size; i++)
+				kernelSpectrum[i] = circularKernel[i];
+			transform(kernelSpectrum, false);
+
+			// The 1/M of the inverse transform is folded into the kernel spectrum.
+			for (auto& value : kernelSpectrum)
+				value /= static_cast<double>(transformSize);
+
+			workspace.assign(transformSize, 0.0);
+		}
+
+		void CircularConvolution::convolve(const double* input, double* output)
+		{
+			for (int i = 0; i < size; i++)
+				workspace[i] = input[i];
+			std::fill(workspace.begin() + size, workspace.end(), 0.0);
+
+			transform(workspace, false);
+			for (int i = 0; i < transformSize; i++)
+				workspace[i] = multiply(workspace[i], kernelSpectrum[i]);
+			transform(workspace, true);
+
+			// Linear convolution has 2N - 1 samples; the ones past N wrap around the circle.
+			for (int i = 0; i < size; i++)
+				output[i] = workspace[i].real() + (i + size < transformSize ? workspace[i + size].real() : 0.0);
+		}
+
+		int CircularConvolution::getSize() const
+		{
+			return size;
+		}
+
+		int CircularConvolution::getTransformSize() const
+		{
+			return transformSize;
+		}
+
+		double CircularConvolution::estimateCost(int size)
+		{
+			// Two transforms of M log2(M) butterflies (about 4 multiply-adds each), plus the product and the fold.
+			const double m = nextPowerOfTwo(2 * size - 1);
+			return 8.0 * m * std::log2(m) + 6.0 * m;
+		}
+
+		void CircularConvolution::transform(std::vector<std::complex<double>>& data, bool inverse) const
+		{
+			// Iterative in-place Cooley-Tukey; the inverse uses conjugate twiddles and is left unscaled.
+			for (int i = 0; i < transformSize; i++)
+				if (i < bitReversal[i])
+					std::swap(data[i], data[bitReversal[i]]);
+
+			for (int length = 2; length <= transformSize; length <<= 1)
+			{
+				const int half = length / 2;
+				const int twiddleStride = transformSize / length;
+				for (int start = 0; start < transformSize; start += length)
+				{
+					for (int k = 0; k < half; k++)
+					{
+						const std::complex<double> twiddle = inverse ? std::conj(twiddles[k * twiddleStride]) : twiddles[k * twiddleStride];
+						const std::complex<double> odd = multiply(data[start + k + half], twiddle);
+						data[start + k + half] = data[start + k] - odd;
+						data[start + k] += odd;
+					}
+				}
+			}
+		}
+	}
+}
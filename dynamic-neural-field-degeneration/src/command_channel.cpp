@@ -0,0 +1,39 @@
+#include "command_channel.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		void CommandLatencyStatistics::addHandoff(CommandClock::time_point pushTime, CommandClock::time_point startTime)
+		{
+			const double microseconds = std::chrono::duration<double, std::micro>(startTime - pushTime).count();
+			numberOfHandoffs++;
+			totalHandoffMicroseconds += microseconds;
+			maxHandoffMicroseconds = std::max(maxHandoffMicroseconds, microseconds);
+		}
+
+		void CommandLatencyStatistics::addRoundTrip(CommandClock::time_point pushTime, CommandClock::time_point wakeTime)
+		{
+			const double microseconds = std::chrono::duration<double, std::micro>(wakeTime - pushTime).count();
+			numberOfRoundTrips++;
+			totalRoundTripMicroseconds += microseconds;
+			maxRoundTripMicroseconds = std::max(maxRoundTripMicroseconds, microseconds);
+		}
+
+		std::string CommandLatencyStatistics::toString() const
+		{
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(2);
+			stream << numberOfHandoffs << " commands handed over in "
+				<< (numberOfHandoffs > 0 ? totalHandoffMicroseconds / static_cast<double>(numberOfHandoffs) : 0.0)
+				<< " us on average (max of " << maxHandoffMicroseconds << " us), " << numberOfRoundTrips << " waits completed in "
+				<< (numberOfRoundTrips > 0 ? totalRoundTripMicroseconds / static_cast<double>(numberOfRoundTrips) : 0.0)
+				<< " us on average (max of " << maxRoundTripMicroseconds << " us).";
+			return stream.str();
+		}
+	}
+}
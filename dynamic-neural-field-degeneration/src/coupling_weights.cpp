@@ -0,0 +1,428 @@
+#include "coupling_weights.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		CouplingWeights::CouplingWeights(const CouplingWeights& other)
+			: rows(other.rows), cols(other.cols), stride(other.stride),
+			values(other.data(), other.data() + static_cast<size_t>(other.rows) * other.stride)
+		{
+		}
+
+		CouplingWeights& CouplingWeights::operator=(const CouplingWeights& other)
+		{
+			if (this != &other)
+			{
+				rows = other.rows;
+				cols = other.cols;
+				stride = other.stride;
+				values.assign(other.data(), other.data() + static_cast<size_t>(other.rows) * other.stride);
+				viewed = nullptr;
+				viewedOwner.reset();
+			}
+			return *this;
+		}
+
+		CouplingWeights CouplingWeights::view(const double* data, int rows, int cols, int stride, std::shared_ptr<const void> owner)
+		{
+			CouplingWeights weights;
+			weights.rows = rows;
+			weights.cols = cols;
+			weights.stride = stride;
+			weights.viewed = data;
+			weights.viewedOwner = std::move(owner);
+			return weights;
+		}
+
+		void CouplingWeights::resize(int rows, int cols)
+		{
+			viewed = nullptr;
+			viewedOwner.reset();
+			this->rows = rows;
+			this->cols = cols;
+			stride = (cols + rowAlignmentInElements - 1) / rowAlignmentInElements * rowAlignmentInElements;
+			values.assign(static_cast<size_t>(rows) * stride, 0.0);
+		}
+
+		void CouplingWeights::assign(const std::vector<std::vector<double>>& weights)
+		{
+			const int numberOfRows = static_cast<int>(weights.size());
+			const int numberOfCols = weights.empty() ? 0 : static_cast<int>(weights.front().size());
+			if (numberOfRows != rows || numberOfCols != cols)
+				resize(numberOfRows, numberOfCols);
+
+			for (int i = 0; i < rows; i++)
+				std::copy(weights[i].begin(), weights[i].end(), row(i));
+		}
+
+		void CouplingWeights::copyTo(std::vector<std::vector<double>>& weights) const
+		{
+			weights.resize(rows);
+			for (int i = 0; i < rows; i++)
+				weights[i].assign(row(i), row(i) + cols);
+		}
+
+		void CouplingWeights::fill(double value)
+		{
+			// Only the logical entries are filled, the row padding stays zero.
+			for (int i = 0; i < rows; i++)
+				std::fill_n(row(i), cols, value);
+		}
+
+		int CouplingWeights::countNonZeros() const
+		{
+			// Counted without a branch, which half-deactivated weights would mispredict every other time.
+			int count = 0;
+			for (int i = 0; i < rows; i++)
+			{
+				const double* w = row(i);
+				for (int j = 0; j < cols; j++)
+					count += w[j] != 0.0;
+			}
+			return count;
+		}
+
+		void CouplingWeights::multiplyTransposed(const double* input, double* output, double scalar) const
+		{
+			// Column blocks of 32 are accumulated in registers over all rows, the rest in blocks of 8.
+			// The stride is a multiple of 8, so the padded tail of a row is read but never written out.
+			alignas(alignment) double sums[rowAlignmentInElements];
+			int col = 0;
+
+#if defined(__AVX512F__)
+			for (; col + 32 <= stride; col += 32)
+			{
+				__m512d acc0 = _mm512_setzero_pd(), acc1 = _mm512_setzero_pd();
+				__m512d acc2 = _mm512_setzero_pd(), acc3 = _mm512_setzero_pd();
+				for (int i = 0; i < rows; i++)
+				{
+					const double* w = row(i) + col;
+					const __m512d x = _mm512_set1_pd(input[i]);
+					acc0 = _mm512_fmadd_pd(x, _mm512_load_pd(w), acc0);
+					acc1 = _mm512_fmadd_pd(x, _mm512_load_pd(w + 8), acc1);
+					acc2 = _mm512_fmadd_pd(x, _mm512_load_pd(w + 16), acc2);
+					acc3 = _mm512_fmadd_pd(x, _mm512_load_pd(w + 24), acc3);
+				}
+				const __m512d s = _mm512_set1_pd(scalar);
+				const __m512d block[4] = { _mm512_mul_pd(acc0, s), _mm512_mul_pd(acc1, s), _mm512_mul_pd(acc2, s), _mm512_mul_pd(acc3, s) };
+				for (int b = 0; b < 4; b++)
+				{
+					_mm512_store_pd(sums, block[b]);
+					const int count = std::clamp(cols - (col + b * 8), 0, 8);
+					std::copy_n(sums, count, output + col + b * 8);
+				}
+			}
+			for (; col < stride; col += 8)
+			{
+				__m512d acc = _mm512_setzero_pd();
+				for (int i = 0; i < rows; i++)
+					acc = _mm512_fmadd_pd(_mm512_set1_pd(input[i]), _mm512_load_pd(row(i) + col), acc);
+				_mm512_store_pd(sums, _mm512_mul_pd(acc, _mm512_set1_pd(scalar)));
+				std::copy_n(sums, std::clamp(cols - col, 0, 8), output + col);
+			}
+#elif defined(__AVX2__)
+			for (; col + 32 <= stride; col += 32)
+			{
+				__m256d acc[8];
+				for (auto& a : acc)
+					a = _mm256_setzero_pd();
+				for (int i = 0; i < rows; i++)
+				{
+					const double* w = row(i) + col;
+					const __m256d x = _mm256_set1_pd(input[i]);
+					for (int b = 0; b < 8; b++)
+						acc[b] = _mm256_fmadd_pd(x, _mm256_load_pd(w + 4 * b), acc[b]);
+				}
+				const __m256d s = _mm256_set1_pd(scalar);
+				for (int b = 0; b < 8; b += 2)
+				{
+					_mm256_store_pd(sums, _mm256_mul_pd(acc[b], s));
+					_mm256_store_pd(sums + 4, _mm256_mul_pd(acc[b + 1], s));
+					const int count = std::clamp(cols - (col + b * 4), 0, 8);
+					std::copy_n(sums, count, output + col + b * 4);
+				}
+			}
+			for (; col < stride; col += 8)
+			{
+				__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+				for (int i = 0; i < rows; i++)
+				{
+					const __m256d x = _mm256_set1_pd(input[i]);
+					acc0 = _mm256_fmadd_pd(x, _mm256_load_pd(row(i) + col), acc0);
+					acc1 = _mm256_fmadd_pd(x, _mm256_load_pd(row(i) + col + 4), acc1);
+				}
+				const __m256d s = _mm256_set1_pd(scalar);
+				_mm256_store_pd(sums, _mm256_mul_pd(acc0, s));
+				_mm256_store_pd(sums + 4, _mm256_mul_pd(acc1, s));
+				std::copy_n(sums, std::clamp(cols - col, 0, 8), output + col);
+			}
+#else
+			for (; col < stride; col += rowAlignmentInElements)
+			{
+				std::fill_n(sums, rowAlignmentInElements, 0.0);
+				for (int i = 0; i < rows; i++)
+				{
+					const double x = input[i];
+					const double* w = row(i) + col;
+					for (int k = 0; k < rowAlignmentInElements; k++)
+						sums[k] += x * w[k];
+				}
+				const int count = std::clamp(cols - col, 0, rowAlignmentInElements);
+				for (int k = 0; k < count; k++)
+					output[col + k] = scalar * sums[k];
+			}
+#endif
+		}
+
+		void SparseCouplingWeights::assign(const CouplingWeights& weights)
+		{
+			rows = weights.getRows();
+			cols = weights.getCols();
+			const int numberOfNonZeros = weights.countNonZeros();
+			columnStarts.resize(static_cast<size_t>(cols) + 1);
+			// Every entry is written and kept only if non-zero (no unpredictable branch at
+			// mid densities), so one slot of slack is needed past the last non-zero.
+			rowIndices.resize(static_cast<size_t>(numberOfNonZeros) + 1);
+			values.resize(static_cast<size_t>(numberOfNonZeros) + 1);
+
+			int k = 0;
+			for (int j = 0; j < cols; j++)
+			{
+				columnStarts[j] = k;
+				for (int i = 0; i < rows; i++)
+				{
+					const double w = weights(i, j);
+					rowIndices[k] = i;
+					values[k] = w;
+					k += w != 0.0;
+				}
+			}
+			columnStarts[cols] = k;
+			rowIndices.resize(numberOfNonZeros);
+			values.resize(numberOfNonZeros);
+			numberOfStoredZeros = 0;
+		}
+
+		bool SparseCouplingWeights::set(int row, int col, double value)
+		{
+			const auto first = rowIndices.begin() + columnStarts[col];
+			const auto last = rowIndices.begin() + columnStarts[col + 1];
+			const auto entry = std::lower_bound(first, last, row);
+			if (entry == last || *entry != row)
+				return value == 0.0;
+
+			double& stored = values[entry - rowIndices.begin()];
+			numberOfStoredZeros += (value == 0.0) - (stored == 0.0);
+			stored = value;
+			return true;
+		}
+
+		void SparseCouplingWeights::compact()
+		{
+			// Entries only move towards the front, so the columns are compacted in place.
+			int k = 0;
+			int start = columnStarts[0];
+			for (int j = 0; j < cols; j++)
+			{
+				const int end = columnStarts[j + 1];
+				columnStarts[j] = k;
+				for (int e = start; e < end; e++)
+				{
+					rowIndices[k] = rowIndices[e];
+					values[k] = values[e];
+					k += values[e] != 0.0;
+				}
+				start = end;
+			}
+			columnStarts[cols] = k;
+			rowIndices.resize(k);
+			values.resize(k);
+			numberOfStoredZeros = 0;
+		}
+
+		void SparseCouplingWeights::multiplyTransposed(const double* input, double* output, double scalar) const
+		{
+			// One gathered dot product per output neuron; the input indices of a column are ascending,
+			// so the gathers walk the (cache resident) input forwards.
+			for (int j = 0; j < cols; j++)
+			{
+				int k = columnStarts[j];
+				const int end = columnStarts[j + 1];
+				double sum = 0.0;
+#if defined(__AVX2__)
+				__m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+				for (; k + 8 <= end; k += 8)
+				{
+					const __m128i i0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowIndices.data() + k));
+					const __m128i i1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rowIndices.data() + k + 4));
+					acc0 = _mm256_fmadd_pd(_mm256_i32gather_pd(input, i0, 8), _mm256_loadu_pd(values.data() + k), acc0);
+					acc1 = _mm256_fmadd_pd(_mm256_i32gather_pd(input, i1, 8), _mm256_loadu_pd(values.data() + k + 4), acc1);
+				}
+				alignas(32) double lanes[4];
+				_mm256_store_pd(lanes, _mm256_add_pd(acc0, acc1));
+				sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+				for (; k < end; k++)
+					sum += values[k] * input[rowIndices[k]];
+				output[j] = scalar * sum;
+			}
+		}
+
+		void OverlayCouplingWeights::setBase(std::shared_ptr<const CouplingWeights> base)
+		{
+			this->base = std::move(base);
+			baseNonZeros = this->base ? this->base->countNonZeros() : 0;
+			rowChanges.assign(static_cast<size_t>(getRows()), {});
+			changedRows.clear();
+			reset();
+		}
+
+		void OverlayCouplingWeights::reset()
+		{
+			for (const int row : changedRows)
+				rowChanges[row].clear();
+			changedRows.clear();
+			numberOfChanges = 0;
+			dense = CouplingWeights();
+			isDense = false;
+		}
+
+		double OverlayCouplingWeights::operator()(int row, int col) const
+		{
+			if (isDense)
+				return dense(row, col);
+			for (const Change& change : rowChanges[row])
+				if (change.col == col)
+					return change.value;
+			return (*base)(row, col);
+		}
+
+		void OverlayCouplingWeights::set(int row, int col, double value)
+		{
+			if (isDense)
+			{
+				dense(row, col) = value;
+				return;
+			}
+
+			std::vector<Change>& changes = rowChanges[row];
+			const double delta = value - (*base)(row, col);
+			for (Change& change : changes)
+				if (change.col == col)
+				{
+					change = { col, value, delta };
+					return;
+				}
+
+			if (changes.empty())
+				changedRows.push_back(row);
+			changes.push_back({ col, value, delta });
+			if (++numberOfChanges * materializationDivisor > getRows() * getCols())
+				materialize();
+		}
+
+		int OverlayCouplingWeights::countNonZeros() const
+		{
+			if (isDense)
+				return dense.countNonZeros();
+			int count = baseNonZeros;
+			for (const int row : changedRows)
+				for (const Change& change : rowChanges[row])
+					count += (change.value != 0.0) - ((*base)(row, change.col) != 0.0);
+			return count;
+		}
+
+		const CouplingWeights& OverlayCouplingWeights::getDense()
+		{
+			if (!isDense && numberOfChanges == 0)
+				return *base;
+			return materialize();
+		}
+
+		CouplingWeights& OverlayCouplingWeights::materialize()
+		{
+			if (isDense)
+				return dense;
+
+			dense = *base;
+			for (const int row : changedRows)
+			{
+				for (const Change& change : rowChanges[row])
+					dense(row, change.col) = change.value;
+				rowChanges[row].clear();
+			}
+			changedRows.clear();
+			numberOfChanges = 0;
+			isDense = true;
+			return dense;
+		}
+
+		void OverlayCouplingWeights::copyTo(CouplingWeights& weights) const
+		{
+			weights = isDense ? dense : *base;
+			for (const int row : changedRows)
+				for (const Change& change : rowChanges[row])
+					weights(row, change.col) = change.value;
+		}
+
+		void OverlayCouplingWeights::copyTo(std::vector<std::vector<double>>& weights) const
+		{
+			if (isDense)
+			{
+				dense.copyTo(weights);
+				return;
+			}
+			base->copyTo(weights);
+			for (const int row : changedRows)
+				for (const Change& change : rowChanges[row])
+					weights[row][change.col] = change.value;
+		}
+
+		void OverlayCouplingWeights::copyRowTo(int row, double* weights) const
+		{
+			if (isDense)
+			{
+				std::copy_n(dense.row(row), getCols(), weights);
+				return;
+			}
+			std::copy_n(base->row(row), getCols(), weights);
+			for (const Change& change : rowChanges[row])
+				weights[change.col] = change.value;
+		}
+
+		void OverlayCouplingWeights::multiplyTransposed(const double* input, double* output, double scalar) const
+		{
+			if (isDense)
+			{
+				dense.multiplyTransposed(input, output, scalar);
+				return;
+			}
+
+			base->multiplyTransposed(input, output, scalar);
+			for (const int row : changedRows)
+			{
+				const double x = scalar * input[row];
+				for (const Change& change : rowChanges[row])
+					output[change.col] += change.delta * x;
+			}
+		}
+
+		void OverlayCouplingWeights::addScaledRow(int row, double factor, double* sums) const
+		{
+			const int cols = getCols();
+			const double* __restrict w = isDense ? dense.row(row) : base->row(row);
+			for (int j = 0; j < cols; j++)
+				sums[j] += factor * w[j];
+			if (!isDense)
+				for (const Change& change : rowChanges[row])
+					sums[change.col] += factor * change.delta;
+		}
+	}
+}
@@ -1,5 +1,8 @@
 #include "degenerate_field_coupling.h"
 
+#include <cmath>
+#include <filesystem>
+
 DegenerateFieldCoupling::DegenerateFieldCoupling(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
 	const dnf_composer::element::FieldCouplingParameters& parameters)
 	: FieldCoupling(elementCommonParameters, parameters)
@@ -11,15 +14,55 @@ DegenerateFieldCoupling::DegenerateFieldCoupling(const dnf_composer::element::El
 
 void DegenerateFieldCoupling::init()
 {
-	FieldCoupling::init();
+	// The first init() loads the shared base weights: the binary weight file is mapped without parsing, and
+	// without a valid one FieldCoupling reads its text weights. A binary file that failed validation (stale,
+	// corrupted or for other parameters) is then rewritten from them. Every later init() (one per trial)
+	// only drops the changes of the previous trial, and only the rows they touched are synchronized again.
+	if (couplingWeights.getBase())
+	{
+		clearComponents();
+		if (couplingWeights.isMaterialized())
+			areWeightsSynchronized = false;
+		else
+			for (const int row : couplingWeights.getChangedRows())
+				markRowUnsynchronized(row);
+	}
+	else
+	{
+		if (!loadMappedWeights())
+		{
+			FieldCoupling::init();
+			experiment::degeneration::CouplingWeights textWeights;
+			textWeights.assign(weights);
+			if (std::filesystem::exists(getWeightsFilename()) && std::filesystem::exists(getTextWeightsFilename()))
+				experiment::degeneration::writeWeightsFile(getWeightsFilename(), textWeights, getTrainingChecksum(), getUniqueName(), getTextWeightsFilename());
+			couplingWeights.setBase(experiment::degeneration::shareCouplingWeights(std::move(textWeights)));
+		}
+		isRowUnsynchronized.assign(couplingWeights.getRows(), 0);
+		unsynchronizedRows.clear();
+		areWeightsSynchronized = false;
+	}
+	couplingWeights.reset();
+	synchronizeWeights();
+	input = getComponentPtr("input");
+	output = getComponentPtr("output");
+	actualOutput.assign(couplingWeights.getStride(), 0.0);
+	error.assign(couplingWeights.getStride(), 0.0);
+	lastInput.assign(couplingWeights.getRows(), 0.0);
+	incrementalSums.assign(couplingWeights.getStride(), 0.0);
+	invalidateWeightCaches();
 	populateIndicesForDegeneration(); // uncomment for inducing degeneration experiment
 	findMinMaxWeightValues();
 	degenerate = false;
 }
 
-void DegenerateFieldCoupling::step(double t, double deltaT)
+void DegenerateFieldCoupling::step(double /*t*/, double /*deltaT*/)
 {
-	FieldCoupling::step(t, deltaT);
+	updateInput();
+	if (isIncrementalOutputOn)
+		updateOutputIncrementally();
+	else
+		multiply(input->data(), output->data(), parameters.scalar);
 	if (degenerate)
 		applyDegeneracy();
 }
@@ -31,7 +74,7 @@ void DegenerateFieldCoupling::startDegeneration()
 
 void DegenerateFieldCoupling::updateWeights(const std::vector<double>& input, const std::vector<double>& output)
 {
-	weights = learningRuleDegenerate(weights, input, output, parameters.learningRate);
+	learningRuleDegenerate(input, output, parameters.learningRate);
 	//writeWeights();
 }
 
@@ -40,34 +83,35 @@ void DegenerateFieldCoupling::setNumWeightsToDegenerate(int count)
 	numWeightsToDegenerate = count;
 }
 
+void DegenerateFieldCoupling::setDegenerationSeed(std::uint64_t seed, std::uint64_t orderStream, std::uint64_t valueStream)
+{
+	degenerationOrder.setSeed(seed, orderStream);
+	this->valueStream = valueStream;
+}
+
 void DegenerateFieldCoupling::applyDegeneracy()
 {
 	switch (degeneracyType)
 	{
 	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_DEACTIVATE:
-		for (int i = 0; i < numWeightsToDegenerate; i++)
-			setRandomUniqueWeightToZero();
-		degenerate = false;
-		break;
 	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_RANDOMIZE:
-		for (int i = 0; i < numWeightsToDegenerate; i++)
-			setRandomUniqueWeightToRandomValue();
-		degenerate = false;
-		break;
 	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_REDUCE:
 		for (int i = 0; i < numWeightsToDegenerate; i++)
-			setRandomUniqueWeightToReduceValue();
+			degenerateNextWeight();
+		if (degenerationOrder.isExhausted())
+			log(dnf_composer::tools::logger::LogLevel::INFO, "No more unique combinations to degenerate");
 		degenerate = false;
 		break;
 	default:
 		log(dnf_composer::tools::logger::LogLevel::ERROR, "Degeneracy type not supported");
 		break;
 	}
+	synchronizeWeights();
 }
 
 int DegenerateFieldCoupling::getNumIndicesForDegeneration() const
 {
-	return static_cast<int>(indicesForDegeneration.size());
+	return degenerationOrder.getNumberOfRemaining();
 }
 
 void DegenerateFieldCoupling::setDegeneracyType(experiment::degeneration::ElementDegeneracyType degeneracyType)
@@ -80,24 +124,232 @@ experiment::degeneration::ElementDegeneracyType DegenerateFieldCoupling::getDege
 	return degeneracyType;
 }
 
-void DegenerateFieldCoupling::populateIndicesForDegeneration()
+const experiment::degeneration::OverlayCouplingWeights& DegenerateFieldCoupling::getCouplingWeights() const
+{
+	return couplingWeights;
+}
+
+void DegenerateFieldCoupling::setCouplingWeights(const experiment::degeneration::OverlayCouplingWeights& couplingWeights)
+{
+	this->couplingWeights = couplingWeights;
+	areWeightsSynchronized = false;
+	invalidateWeightCaches();
+}
+
+std::string DegenerateFieldCoupling::getWeightsFilename() const
+{
+	return std::string(OUTPUT_DIRECTORY) + "/weights-backup/" + getUniqueName() + "_weights.dnfw";
+}
+
+std::string DegenerateFieldCoupling::getTextWeightsFilename() const
+{
+	return std::string(OUTPUT_DIRECTORY) + "/weights-backup/" + getUniqueName() + "_weights.txt";
+}
+
+std::uint64_t DegenerateFieldCoupling::getTrainingChecksum() const
+{
+	// Name, shape and learning rule of the coupling; the scalar only scales the output of trained weights.
+	const std::string name = getUniqueName();
+	const std::int64_t shape[] = { parameters.inputFieldSize, commonParameters.dimensionParameters.size, static_cast<std::int64_t>(parameters.learningRule) };
+	const double rates[] = { parameters.learningRate, commonParameters.dimensionParameters.d_x };
+	std::uint64_t checksum = experiment::degeneration::getChecksum(name.data(), name.size());
+	checksum = experiment::degeneration::getChecksum(shape, sizeof(shape), checksum);
+	return experiment::degeneration::getChecksum(rates, sizeof(rates), checksum);
+}
+
+bool DegenerateFieldCoupling::loadMappedWeights()
+{
+	const auto mappedWeights = experiment::degeneration::mapWeightsFile(getWeightsFilename(), parameters.inputFieldSize,
+		commonParameters.dimensionParameters.size, getTrainingChecksum(), getTextWeightsFilename());
+	if (!mappedWeights)
+		return false;
+
+	clearComponents();
+	couplingWeights.setBase(experiment::degeneration::viewMappedWeights(mappedWeights));
+	return true;
+}
+
+void DegenerateFieldCoupling::clearComponents()
+{
+	// What FieldCoupling::init() does besides reading the weights.
+	getComponentPtr("input")->assign(parameters.inputFieldSize, 0.0);
+	getComponentPtr("output")->assign(commonParameters.dimensionParameters.size, 0.0);
+}
+
+void DegenerateFieldCoupling::synchronizeWeights()
+{
+	// Keep the base class weights (used for reading/writing and visualization) in sync: a degeneration
+	// copies the few rows it changed, a learning step or a new set of weights all of them.
+	if (!areWeightsSynchronized)
+	{
+		couplingWeights.copyTo(weights);
+		areWeightsSynchronized = true;
+	}
+	else
+		for (const int row : unsynchronizedRows)
+			couplingWeights.copyRowTo(row, weights[row].data());
+
+	for (const int row : unsynchronizedRows)
+		isRowUnsynchronized[row] = 0;
+	unsynchronizedRows.clear();
+}
+
+void DegenerateFieldCoupling::markRowUnsynchronized(int row_idx)
+{
+	if (isRowUnsynchronized[row_idx])
+		return;
+	isRowUnsynchronized[row_idx] = 1;
+	unsynchronizedRows.push_back(row_idx);
+}
+
+void DegenerateFieldCoupling::setSparseDensityThreshold(double threshold)
+{
+	sparseDensityThreshold = threshold;
+}
+
+double DegenerateFieldCoupling::getDensity() const
+{
+	const int numberOfWeights = couplingWeights.getRows() * couplingWeights.getCols();
+	return numberOfWeights > 0 ? static_cast<double>(numberOfNonZeroWeights) / numberOfWeights : 1.0;
+}
+
+bool DegenerateFieldCoupling::isSparseProductOn() const
+{
+	return isSparse;
+}
+
+void DegenerateFieldCoupling::setIncrementalOutput(bool isIncrementalOutputOn, double inputTolerance, int resyncSteps)
+{
+	this->isIncrementalOutputOn = isIncrementalOutputOn;
+	incrementalInputTolerance = inputTolerance;
+	incrementalResyncSteps = resyncSteps;
+	isIncrementalOutputValid = false;
+}
+
+void DegenerateFieldCoupling::setWeight(int row_idx, int col_idx, double value)
+{
+	// Single weight changes keep the non-zero count, the sparse copy and the incremental output up to
+	// date, degenerations come every few settling steps and a rebuild would cost more than it saves.
+	const double previous = couplingWeights(row_idx, col_idx);
+	couplingWeights.set(row_idx, col_idx, value);
+	numberOfNonZeroWeights += (value != 0.0) - (previous != 0.0);
+	if (isSparse && !isSparseOutdated && !sparseWeights.set(row_idx, col_idx, value))
+		isSparseOutdated = true;
+	if (isIncrementalOutputValid)
+		incrementalSums[col_idx] += (value - previous) * lastInput[row_idx];
+	markRowUnsynchronized(row_idx);
+}
+
+void DegenerateFieldCoupling::invalidateWeightCaches()
+{
+	// After a bulk change of the weights.
+	numberOfNonZeroWeights = couplingWeights.countNonZeros();
+	isSparseOutdated = true;
+	isIncrementalOutputValid = false;
+}
+
+void DegenerateFieldCoupling::updateProductRepresentation()
+{
+	// The sparse copy is only maintained while it is used: it is assigned again when the density
+	// drops below the threshold (or after a bulk change) and compacted once an eighth of it is zeros.
+	const bool wasSparse = isSparse;
+	isSparse = getDensity() < sparseDensityThreshold;
+	if (!isSparse)
+		return;
+
+	if (!wasSparse || isSparseOutdated)
+	{
+		sparseWeights.assign(couplingWeights.getDense());
+		isSparseOutdated = false;
+	}
+	else if (sparseWeights.getNumberOfStoredZeros() * 8 > sparseWeights.getNumberOfEntries())
+		sparseWeights.compact();
+}
+
+void DegenerateFieldCoupling::multiply(const double* input, double* output, double scalar)
 {
-	for (int i = 0; i < components["output"].size(); i++)
+	// Same product as FieldCoupling, computed from the contiguous copy of the weights
+	// or, once enough weights are deactivated, from its sparse copy.
+	updateProductRepresentation();
+	if (isSparse)
+		sparseWeights.multiplyTransposed(input, output, scalar);
+	else
+		couplingWeights.multiplyTransposed(input, output, scalar);
+}
+
+void DegenerateFieldCoupling::updateOutputIncrementally()
+{
+	// incrementalSums holds W^T x for the kept input x: weight changes add (w' - w) x_i in setWeight and
+	// inputs that moved by more than the tolerance add (x'_i - x_i) times their row here. Inputs within the
+	// tolerance keep their old value, so a sum is off by at most tolerance * sum_i |w_ij|. The full product
+	// is taken again every incrementalResyncSteps steps (bounding the rounding drift) and whenever more
+	// than a quarter of the inputs moved, where the row updates would cost about as much.
+	const int rows = couplingWeights.getRows();
+	const int cols = couplingWeights.getCols();
+	const double* x = input->data();
+
+	bool isResyncDue = !isIncrementalOutputValid || ++stepsSinceResync >= incrementalResyncSteps;
+	if (!isResyncDue)
+	{
+		changedInputs.clear();
+		for (int i = 0; i < rows; i++)
+			if (std::abs(x[i] - lastInput[i]) > incrementalInputTolerance)
+				changedInputs.push_back(i);
+		isResyncDue = static_cast<int>(changedInputs.size()) * 4 > rows;
+	}
+
+	if (isResyncDue)
+	{
+		multiply(x, incrementalSums.data(), 1.0);
+		std::copy_n(x, rows, lastInput.begin());
+		stepsSinceResync = 0;
+		isIncrementalOutputValid = true;
+	}
+	else
 	{
-		for (int j = 0; j < components["input"].size(); j++)
+		double* __restrict sums = incrementalSums.data();
+		for (const int i : changedInputs)
 		{
-			std::pair<int, int> pair(j, i);
-			indicesForDegeneration.insert(pair);
+			couplingWeights.addScaledRow(i, x[i] - lastInput[i], sums);
+			lastInput[i] = x[i];
 		}
 	}
+
+	double* out = output->data();
+	for (int j = 0; j < cols; j++)
+		out[j] = parameters.scalar * incrementalSums[j];
+}
+
+void DegenerateFieldCoupling::populateIndicesForDegeneration()
+{
+	// Weight (j, i) - input j, output i - is candidate j * outputSize + i.
+	degenerationOrder.reset(couplingWeights.getRows() * couplingWeights.getCols());
+	randomValueGenerator.seed(degenerationOrder.getSeed(), valueStream);
+	degeneratedWeights.clear();
+	isPlasticityMaskValid = false;
+}
+
+bool DegenerateFieldCoupling::takeNextWeightForDegeneration(int& row_idx, int& col_idx)
+{
+	const int index = degenerationOrder.next();
+	if (index < 0)
+		return false;
+
+	const int outputSize = couplingWeights.getCols();
+	row_idx = index / outputSize;
+	col_idx = index % outputSize;
+	degeneratedWeights.push_back(index);
+	if (isPlasticityMaskValid)
+		plasticityMask(row_idx, col_idx) = 0.0;
+	return true;
 }
 
 void DegenerateFieldCoupling::findMinMaxWeightValues()
 {
 	// Find the minimum and maximum values of the weights
-	for (int i = 0; i < components["output"].size(); i++)
+	for (int i = 0; i < couplingWeights.getCols(); i++)
 	{
-		for (int j = 0; j < components["input"].size(); j++)
+		for (int j = 0; j < couplingWeights.getRows(); j++)
 		{
 			minWeightValue = std::min(minWeightValue, weights[j][i]);
 			maxWeightValue = std::max(maxWeightValue, weights[j][i]) - 0.001;// -0.0055;
@@ -107,10 +359,10 @@ void DegenerateFieldCoupling::findMinMaxWeightValues()
 
 void DegenerateFieldCoupling::setRandomWeightToRandomValue()
 {
-	const int row_idx = dnf_composer::tools::utils::generateRandomNumber(0, static_cast<int>(components["input"].size()) - 1);
-	const int col_idx = dnf_composer::tools::utils::generateRandomNumber(0, static_cast<int>(components["output"].size()) - 1);
-	const double aux = dnf_composer::tools::utils::generateRandomNumber(minWeightValue, maxWeightValue);
-	weights[row_idx][col_idx] = aux;
+	const int row_idx = static_cast<int>(randomValueGenerator.below(couplingWeights.getRows()));
+	const int col_idx = static_cast<int>(randomValueGenerator.below(couplingWeights.getCols()));
+	const double aux = randomValueGenerator.uniform(minWeightValue, maxWeightValue);
+	setWeight(row_idx, col_idx, aux);
 }
 
 void DegenerateFieldCoupling::setWeightReductionFactor(const double& factor)
@@ -123,150 +375,138 @@ double DegenerateFieldCoupling::getWeightReductionFactor() const
 	return weightReductionFactor;
 }
 
+double DegenerateFieldCoupling::getScalar() const
+{
+	return parameters.scalar;
+}
+
+double DegenerateFieldCoupling::getMinWeightValue() const
+{
+	return minWeightValue;
+}
+
+double DegenerateFieldCoupling::getMaxWeightValue() const
+{
+	return maxWeightValue;
+}
+
 void DegenerateFieldCoupling::setRandomWeightToReduceValue()
 {
 	while (true)
 	{
-		const int row_idx = dnf_composer::tools::utils::generateRandomNumber(0, static_cast<int>(components["input"].size()) - 1);
-		const int col_idx = dnf_composer::tools::utils::generateRandomNumber(0, static_cast<int>(components["output"].size()) - 1);
-		if (weights[row_idx][col_idx] != 0)
+		const int row_idx = static_cast<int>(randomValueGenerator.below(couplingWeights.getRows()));
+		const int col_idx = static_cast<int>(randomValueGenerator.below(couplingWeights.getCols()));
+		if (couplingWeights(row_idx, col_idx) != 0)
 		{
-			weights[row_idx][col_idx] = weights[row_idx][col_idx] * weightReductionFactor;
+			setWeight(row_idx, col_idx, couplingWeights(row_idx, col_idx) * weightReductionFactor);
 			break;
 		}
 	}
 }
 
-void DegenerateFieldCoupling::setRandomUniqueWeightToRandomValue()
+void DegenerateFieldCoupling::degenerateNextWeight()
 {
-	bool uniqueCombinationFound = false; // Flag to indicate if a unique combination is found
-
-	// Loop until a unique combination is found or indicesForDegeneration is empty
-	while (!uniqueCombinationFound && !indicesForDegeneration.empty())
-	{
-		int size = static_cast<int>(indicesForDegeneration.size()) - 1;
-		// Get a random iterator from the set
-		auto randomIterator = std::next(indicesForDegeneration.begin(), dnf_composer::tools::utils::generateRandomNumber(0, size));
-
-		// Get the pair from the iterator
-		const std::pair<int, int> pair = *randomIterator;
-
-		// Erase the combination from the set
-		indicesForDegeneration.erase(randomIterator);
-
-		const int row_idx = pair.first;
-		const int col_idx = pair.second;
-
-		const double aux = dnf_composer::tools::utils::generateRandomNumber(minWeightValue, maxWeightValue);
-		weights[row_idx][col_idx] = aux;
-
-		uniqueCombinationFound = true; // Set flag to indicate combination found
-	}
+	int row_idx, col_idx;
+	if (takeNextWeightForDegeneration(row_idx, col_idx))
+		degenerateWeight(row_idx, col_idx);
 }
 
-void DegenerateFieldCoupling::setRandomUniqueWeightToReduceValue()
+void DegenerateFieldCoupling::degenerateWeight(int row_idx, int col_idx)
 {
-	bool uniqueCombinationFound = false; // Flag to indicate if a unique combination is found
-
-	// Loop until a unique combination is found or indicesForDegeneration is empty
-	while (!uniqueCombinationFound && !indicesForDegeneration.empty())
+	switch (degeneracyType)
 	{
-		int size = static_cast<int>(indicesForDegeneration.size()) - 1;
-		// Get a random iterator from the set
-		auto randomIterator = std::next(indicesForDegeneration.begin(), dnf_composer::tools::utils::generateRandomNumber(0, size));
-
-		// Get the pair from the iterator
-		const std::pair<int, int> pair = *randomIterator;
-
-		// Erase the combination from the set
-		indicesForDegeneration.erase(randomIterator);
-
-		const int row_idx = pair.first;
-		const int col_idx = pair.second;
-
-		// Set weight at combination to 0
-		weights[row_idx][col_idx] = weights[row_idx][col_idx] * weightReductionFactor;
-
-		uniqueCombinationFound = true; // Set flag to indicate combination found
+	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+		setWeight(row_idx, col_idx, 0);
+		break;
+	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_RANDOMIZE:
+		setWeight(row_idx, col_idx, randomValueGenerator.uniform(minWeightValue, maxWeightValue));
+		break;
+	case experiment::degeneration::ElementDegeneracyType::WEIGHTS_REDUCE:
+		setWeight(row_idx, col_idx, couplingWeights(row_idx, col_idx) * weightReductionFactor);
+		break;
+	default:
+		break;
 	}
 }
 
-
-void DegenerateFieldCoupling::setRandomUniqueWeightToZero()
+void DegenerateFieldCoupling::degenerateFirst(int count)
 {
-	bool uniqueCombinationFound = false; // Flag to indicate if a unique combination is found
-	//static int count = 0;
-
-	// Loop until a unique combination is found or indicesForDegeneration is empty
-	while (!uniqueCombinationFound && !indicesForDegeneration.empty())
+	// Jump straight to the state where the first count weights of this trial's order have degenerated.
+	// The weights must hold their pre-degeneration values (e.g. restored from a checkpoint); randomized
+	// values are drawn again from the start of this trial's stream, so every jump yields the same weights.
+	randomValueGenerator.seed(degenerationOrder.getSeed(), valueStream);
+	degeneratedWeights.clear();
+	isPlasticityMaskValid = false;
+
+	const int outputSize = couplingWeights.getCols();
+	for (const int index : degenerationOrder.takeFirst(count))
 	{
-		int size = static_cast<int>(indicesForDegeneration.size()) - 1;
-		// Get a random iterator from the set
-		auto randomIterator = std::next(indicesForDegeneration.begin(), dnf_composer::tools::utils::generateRandomNumber(0, size));
-
-		// Get the pair from the iterator
-		const std::pair<int, int> pair = *randomIterator;
-
-		// Erase the combination from the set
-		indicesForDegeneration.erase(randomIterator);
-
-		const int row_idx = pair.first;
-		const int col_idx = pair.second;
-
-		// Set weight at combination to 0
-		weights[row_idx][col_idx] = 0;
-
-		uniqueCombinationFound = true; // Set flag to indicate combination found
+		degeneratedWeights.push_back(index);
+		degenerateWeight(index / outputSize, index % outputSize);
 	}
+	degenerate = false;
+	synchronizeWeights();
+}
 
-	if (indicesForDegeneration.empty())
-	{
-		std::cout << "No more unique combinations to degenerate" << std::endl;
-	}
+int DegenerateFieldCoupling::getNumberOfCandidatesForDegeneration() const
+{
+	return degenerationOrder.getNumberOfCandidates();
 }
 
-std::vector<std::vector<double>> DegenerateFieldCoupling::learningRuleDegenerate(std::vector<std::vector<double>>& weights,
-	const std::vector<double>& input, const std::vector<double>& targetOutput, const double& learningRate) const
+void DegenerateFieldCoupling::updatePlasticityMask()
 {
+	// Built at the first learning step that keeps the degenerated weights and then kept up to date by
+	// takeNextWeightForDegeneration, so trials without relearning hold no second dense matrix.
+	const int outputSize = couplingWeights.getCols();
+	if (plasticityMask.getRows() != couplingWeights.getRows() || plasticityMask.getCols() != outputSize)
+		plasticityMask.resize(couplingWeights.getRows(), outputSize);
+	plasticityMask.fill(1.0);
+	for (const int index : degeneratedWeights)
+		plasticityMask(index / outputSize, index % outputSize) = 0.0;
+	isPlasticityMaskValid = true;
+}
 
+void DegenerateFieldCoupling::learningRuleDegenerate(const std::vector<double>& input, const std::vector<double>& targetOutput,
+	const double& learningRate)
+{
+	// In-place delta rule on the contiguous weights, materialized since a step changes them all;
+	// the scratch buffers are sized in init().
 	const double eta = 0.5;
 
-	const size_t inputSize = input.size();
-	const size_t outputSize = targetOutput.size(); //fixed from int to size_t
+	experiment::degeneration::CouplingWeights& dense = couplingWeights.materialize();
+	const int inputSize = dense.getRows();
+	const int outputSize = dense.getCols();
+	const int stride = dense.getStride();
+	if (!updateAllWeights && !isPlasticityMaskValid)
+		updatePlasticityMask();
 
 	// Calculate the activation levels of the fields based on the input values and current weights
-	std::vector<double> actualOutput(outputSize, 0.0);
-	for (size_t j = 0; j < outputSize; ++j) {
-		for (size_t i = 0; i < inputSize; ++i) {
-			actualOutput[j] += input[i] * weights[i][j];
-		}
-	}
+	dense.multiplyTransposed(input.data(), actualOutput.data(), 1.0);
 
-	// Calculate the error between the target output and the actual output
-	std::vector<double> error(outputSize, 0.0);
-	for (size_t j = 0; j < outputSize; ++j) {
+	// Calculate the error between the target output and the actual output (the padding stays zero)
+	for (int j = 0; j < outputSize; ++j)
 		error[j] = targetOutput[j] - actualOutput[j];
-	}
 
-	// Update the weights based on the error and current activation levels of the fields
-	for (size_t i = 0; i < inputSize; ++i) {
-		for (size_t j = 0; j < outputSize; ++j)
+	// Update the weights based on the error and current activation levels of the fields.
+	// Degenerated weights have a zero in the plasticity mask and are left untouched.
+	const double* __restrict e = error.data();
+	for (int i = 0; i < inputSize; ++i)
+	{
+		double* __restrict w = dense.row(i);
+		const double rate = learningRate * input[i];
+
+		if (updateAllWeights)
+			for (int j = 0; j < stride; ++j)
+				w[j] += rate * (e[j] - eta * w[j]);
+		else
 		{
-			// If the pair is found in the set (then it still hasn't degenerated), then update the weight.
-			if (updateAllWeights)
-				weights[i][j] += learningRate * (error[j] - eta * weights[i][j]) * input[i];
-			else
-			{
-				std::pair<int, int> pair(i, j);
-				auto it = std::find(indicesForDegeneration.begin(), indicesForDegeneration.end(), pair);
-				if (it != indicesForDegeneration.end())
-				{
-					weights[i][j] += learningRate * (error[j] - eta * weights[i][j]) * input[i];
-				}
-				// else do nothing
-			}
+			const double* __restrict plastic = plasticityMask.row(i);
+			for (int j = 0; j < stride; ++j)
+				w[j] += rate * (e[j] - eta * w[j]) * plastic[j];
 		}
 	}
 
-	return weights;
-}
\ No newline at end of file
+	// Relearning can bring deactivated weights back, so the density is counted again.
+	areWeightsSynchronized = false;
+	invalidateWeightCaches();
+}
@@ -1,5 +1,7 @@
 #include "degenerate_neural_field.h"
 
+#include "fast_math.h"
+
 DegenerateNeuralField::DegenerateNeuralField(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
 	const dnf_composer::element::NeuralFieldParameters& parameters)
 	: NeuralField(elementCommonParameters, parameters)
@@ -7,40 +9,99 @@ DegenerateNeuralField::DegenerateNeuralField(const dnf_composer::element::Elemen
 	degeneracyType = experiment::degeneration::ElementDegeneracyType::NONE;
 	degenerate = false;
 	populateIndicesForDegeneration();
-	degeneratedIndices.clear();
+	aliveMask.assign(commonParameters.dimensionParameters.size, 1.0);
+	resolveComponentHandles();
 }
 
 void DegenerateNeuralField::init()
 {
 	NeuralField::init();
 	populateIndicesForDegeneration(); // probably wont work in the inducing degeneration experiment
+	aliveMask.resize(commonParameters.dimensionParameters.size, 1.0);
+	resolveComponentHandles();
 	degenerate = false;
 }
 
-void DegenerateNeuralField::calculateActivation(const double& t, const double& deltaT)
+void DegenerateNeuralField::resolveComponentHandles()
+{
+	componentHandles.activation = getComponentPtr("activation");
+	componentHandles.restingLevel = getComponentPtr("resting level");
+	componentHandles.input = getComponentPtr("input");
+	componentHandles.output = getComponentPtr("output");
+}
+
+void DegenerateNeuralField::calculateActivation(const double& /*t*/, const double& deltaT)
+{
+	// The "killed" neurons are zeroed through the alive mask instead of being looked up,
+	// so the loop is branch-free and costs the same regardless of how many neurons are dead.
+	const int size = commonParameters.dimensionParameters.size;
+	const double rate = deltaT / parameters.tau;
+	double* __restrict activation = componentHandles.activation->data();
+	const double* __restrict restingLevel = componentHandles.restingLevel->data();
+	const double* __restrict input = componentHandles.input->data();
+	const double* __restrict mask = aliveMask.data();
+
+	for (int i = 0; i < size; i++)
+		activation[i] = (activation[i] + rate * (-activation[i] + restingLevel[i] + input[i])) * mask[i];
+}
+
+void DegenerateNeuralField::calculateActivationAndOutput(const double& deltaT)
 {
-	for (int i = 0; i < commonParameters.dimensionParameters.size; i++)
+	// Euler step, alive mask and sigmoid output in one sweep over the field.
+	const int size = commonParameters.dimensionParameters.size;
+	const double rate = deltaT / parameters.tau;
+	double* __restrict activation = componentHandles.activation->data();
+	const double* __restrict restingLevel = componentHandles.restingLevel->data();
+	const double* __restrict input = componentHandles.input->data();
+	const double* __restrict mask = aliveMask.data();
+	double* __restrict output = componentHandles.output->data();
+	int i = 0;
+
+	if (isFastSigmoidOn)
 	{
-		auto it = std::find(degeneratedIndices.begin(), degeneratedIndices.end(), i);
-		if (it != degeneratedIndices.end()) // Skip the "killed" neurons
+#if defined(__AVX2__)
+		const __m256d rateVector = _mm256_set1_pd(rate);
+		const __m256d minusSteepness = _mm256_set1_pd(-sigmoidSteepness);
+		const __m256d xShift = _mm256_set1_pd(sigmoidXShift);
+		const __m256d one = _mm256_set1_pd(1.0);
+		for (; i + 4 <= size; i += 4)
 		{
-			components["activation"][i] = 0;
+			const __m256d u = _mm256_loadu_pd(activation + i);
+			const __m256d drive = _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(restingLevel + i), u), _mm256_loadu_pd(input + i));
+			const __m256d updated = _mm256_mul_pd(_mm256_add_pd(u, _mm256_mul_pd(rateVector, drive)), _mm256_loadu_pd(mask + i));
+			_mm256_storeu_pd(activation + i, updated);
+			const __m256d e = experiment::degeneration::fast_math::exp(_mm256_mul_pd(minusSteepness, _mm256_sub_pd(updated, xShift)));
+			_mm256_storeu_pd(output + i, _mm256_div_pd(one, _mm256_add_pd(one, e)));
 		}
-		else
+#endif
+		for (; i < size; i++)
 		{
-			components["activation"][i] = components["activation"][i] + deltaT / parameters.tau *
-				(-components["activation"][i] + components["resting level"][i] + components["input"][i]);
+			activation[i] = (activation[i] + rate * (-activation[i] + restingLevel[i] + input[i])) * mask[i];
+			output[i] = 1.0 / (1.0 + experiment::degeneration::fast_math::exp(-sigmoidSteepness * (activation[i] - sigmoidXShift)));
 		}
+		return;
+	}
+
+	for (; i < size; i++)
+	{
+		activation[i] = (activation[i] + rate * (-activation[i] + restingLevel[i] + input[i])) * mask[i];
+		output[i] = 1.0 / (1.0 + std::exp(-sigmoidSteepness * (activation[i] - sigmoidXShift)));
 	}
 }
 
 void DegenerateNeuralField::step(double t, double deltaT)
 {
 	updateInput();
-	calculateActivation(t, deltaT);
+	// A degeneration only changes the alive mask, which takes effect from the next step on,
+	// so it can follow the fused sweep that already produced this step's output.
+	if (isOutputFused)
+		calculateActivationAndOutput(deltaT);
+	else
+		calculateActivation(t, deltaT);
 	if (degenerate)
 		applyDegeneracy();
-	calculateOutput();
+	if (!isOutputFused)
+		calculateOutput();
 	updateState();
 }
 
@@ -54,6 +115,24 @@ void DegenerateNeuralField::setNumNeuronsToDegenerate(const int& numNeuronsToDeg
 	this->numNeuronsToDegenerate = numNeuronsToDegenerate;
 }
 
+void DegenerateNeuralField::setDegenerationSeed(std::uint64_t seed, std::uint64_t stream)
+{
+	degenerationOrder.setSeed(seed, stream);
+}
+
+void DegenerateNeuralField::setSigmoidOutput(double xShift, double steepness)
+{
+	// Must match the SigmoidFunction of the field parameters, which calculateOutput() would apply.
+	sigmoidXShift = xShift;
+	sigmoidSteepness = steepness;
+	isOutputFused = true;
+}
+
+void DegenerateNeuralField::setFastSigmoid(bool isFastSigmoidOn)
+{
+	this->isFastSigmoidOn = isFastSigmoidOn;
+}
+
 void DegenerateNeuralField::applyDegeneracy()
 {
 	switch (degeneracyType)
@@ -83,80 +162,134 @@ experiment::degeneration::ElementDegeneracyType DegenerateNeuralField::getDegene
 
 double DegenerateNeuralField::getCentroid()
 {
-	const std::vector<double> f_output = dnf_composer::tools::math::heaviside(components["activation"], 2.0);
-	double centroid = 0.0;
+	return getCentroid(componentHandles.activation->data(), commonParameters.dimensionParameters.size, commonParameters.dimensionParameters.d_x);
+}
+
+double DegenerateNeuralField::getCentroid(const double* activation, int size, double stepSize)
+{
+	// Single pass over the activation: counts the neurons above the output threshold, sums their
+	// indices and counts those in the lower half of the field. The circular distances of the
+	// weighted sum are (i - size/2), plus size in the lower half when the peak wraps around the
+	// limits, so the sum follows from these integers; all terms are exact, as in the per-neuron loop.
+	const ActiveNeuronSums sums = sumActiveNeurons(activation, size, centroidThreshold);
+
+	if (sums.count == 0)
+		return -1.0;
+
+	const double fieldSize = static_cast<double>(size);
+	const bool isAtLimits = (activation[0] > centroidThreshold) || (activation[size - 1] > centroidThreshold);
+
+	const double sumActivation = static_cast<double>(sums.count);
+	double sumWeightedPositions = static_cast<double>(sums.sumOfIndices) - sumActivation * fieldSize * 0.5;
+	if (isAtLimits)
+		sumWeightedPositions += fieldSize * static_cast<double>(sums.countInLowerHalf);
 
-	if (*std::ranges::max_element(f_output) > 0)
+	double centroid = 0.0;
+	static constexpr double epsilon = 1e-6;
+	if (std::fabs(sumActivation) > epsilon)
 	{
-		const bool isAtLimits = (f_output[0] > 0) || (f_output[commonParameters.dimensionParameters.size - 1] > 0);
+		// Shift the centroid back to the circular field
+		centroid = fmod(fieldSize * 0.5 + sumWeightedPositions / sumActivation, fieldSize);
+		if (isAtLimits)
+			centroid = (centroid >= 0 ? centroid : centroid + fieldSize);
+	}
+	return centroid * stepSize + stepSize;
+}
 
-		double sumActivation = 0.0;
-		double sumWeightedPositions = 0.0;
+DegenerateNeuralField::FusedDynamics DegenerateNeuralField::getFusedDynamics() const
+{
+	if (!isOutputFused)
+		dnf_composer::tools::logger::log(dnf_composer::tools::logger::LogLevel::ERROR, "The sigmoid output is not fused, its parameters are unknown");
+	return { parameters.tau, sigmoidXShift, sigmoidSteepness, isFastSigmoidOn };
+}
 
-		for (int i = 0; i < commonParameters.dimensionParameters.size; i++)
-		{
-			const double activation = f_output[i];
-
-			sumActivation += activation;
-
-			// Calculate the circular distance from the midpoint to the position
-			double distance = 0.0;
-			if (isAtLimits)
-				distance = fmod(static_cast<double>(i) - static_cast<double>(commonParameters.dimensionParameters.size) * 0.5 
-					+ static_cast<double>(commonParameters.dimensionParameters.size) * 10, static_cast<double>(commonParameters.dimensionParameters.size));
-			else
-				distance = fmod(static_cast<double>(i) - static_cast<double>(commonParameters.dimensionParameters.size) * 0.5, static_cast<double>(commonParameters.dimensionParameters.size));
-			sumWeightedPositions += distance * activation;
-		}
+const std::vector<double>& DegenerateNeuralField::getAliveMask() const
+{
+	return aliveMask;
+}
 
-		static constexpr double epsilon = 1e-6;
-		if (std::fabs(sumActivation) > epsilon)
-		{
-			// Shift the centroid back to the circular field
-			centroid = fmod(static_cast<double>(commonParameters.dimensionParameters.size) * 0.5 + sumWeightedPositions / sumActivation, static_cast<double>(commonParameters.dimensionParameters.size));
-			if (isAtLimits)
-				centroid = (centroid >= 0 ? centroid : centroid + static_cast<double>(commonParameters.dimensionParameters.size));
-		}
-		centroid = centroid * commonParameters.dimensionParameters.d_x + commonParameters.dimensionParameters.d_x;
+DegenerateNeuralField::ActiveNeuronSums DegenerateNeuralField::sumActiveNeurons(const double* activation, int size, double threshold)
+{
+	ActiveNeuronSums sums;
+	const int lowerHalfEnd = (size + 1) / 2; // i < size / 2
+	int i = 0;
+
+#if defined(__AVX2__)
+	// Compare masks are all ones (-1) in the active lanes: subtracting them counts, and-ing them selects.
+	const __m256d thresholdVector = _mm256_set1_pd(threshold);
+	const __m256i lowerHalfEndVector = _mm256_set1_epi64x(lowerHalfEnd);
+	const __m256i four = _mm256_set1_epi64x(4);
+	__m256i indices = _mm256_setr_epi64x(0, 1, 2, 3);
+	__m256i count = _mm256_setzero_si256();
+	__m256i sumOfIndices = _mm256_setzero_si256();
+	__m256i countInLowerHalf = _mm256_setzero_si256();
+
+	for (; i + 4 <= size; i += 4)
+	{
+		const __m256i isActive = _mm256_castpd_si256(_mm256_cmp_pd(_mm256_loadu_pd(activation + i), thresholdVector, _CMP_GT_OQ));
+		const __m256i isInLowerHalf = _mm256_cmpgt_epi64(lowerHalfEndVector, indices);
+		count = _mm256_sub_epi64(count, isActive);
+		sumOfIndices = _mm256_add_epi64(sumOfIndices, _mm256_and_si256(isActive, indices));
+		countInLowerHalf = _mm256_sub_epi64(countInLowerHalf, _mm256_and_si256(isActive, isInLowerHalf));
+		indices = _mm256_add_epi64(indices, four);
 	}
-	else
+
+	alignas(32) std::int64_t lanes[4];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), count);
+	sums.count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), sumOfIndices);
+	sums.sumOfIndices = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	_mm256_store_si256(reinterpret_cast<__m256i*>(lanes), countInLowerHalf);
+	sums.countInLowerHalf = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	for (; i < size; i++)
 	{
-		centroid = -1.0;
+		const std::int64_t isActive = activation[i] > threshold;
+		sums.count += isActive;
+		sums.sumOfIndices += isActive * i;
+		sums.countInLowerHalf += isActive & (i < lowerHalfEnd);
 	}
-	return centroid;
+	return sums;
 }
 
 void DegenerateNeuralField::clearDegeneration()
 {
-	degeneratedIndices.clear();
+	degenerationOrder.rewind();
+	std::ranges::fill(aliveMask, 1.0);
+}
+
+void DegenerateNeuralField::degenerateFirst(int count)
+{
+	// Jump straight to the state where the first count neurons of this trial's order are dead.
+	std::ranges::fill(aliveMask, 1.0);
+	for (const int index : degenerationOrder.takeFirst(count))
+		aliveMask[index] = 0.0;
+	degenerate = false;
+}
+
+int DegenerateNeuralField::getNumberOfCandidatesForDegeneration() const
+{
+	return degenerationOrder.getNumberOfCandidates();
 }
 
 void DegenerateNeuralField::populateIndicesForDegeneration()
 {
-	for (int i = 0; i < commonParameters.dimensionParameters.size; i++)
-		indicesForDegeneration.push_back(i);
+	degenerationOrder.reset(commonParameters.dimensionParameters.size);
 }
 
 void DegenerateNeuralField::setRandomUniqueNeuronToZero()
 {
-	if (indicesForDegeneration.empty())
-	{
+	const int randomIndex = degenerationOrder.next();
+	if (randomIndex < 0)
 		return;
-	}
-
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_int_distribution<int> dis(0, indicesForDegeneration.size() - 1);
-	const int randomIndex = indicesForDegeneration[dis(gen)];
-
-	degeneratedIndices.push_back(randomIndex);
 
-	indicesForDegeneration.erase(std::remove(indicesForDegeneration.begin(), indicesForDegeneration.end(), randomIndex), indicesForDegeneration.end());
+	aliveMask[randomIndex] = 0.0;
 }
 
 void DegenerateNeuralField::reset()
 {
-	indicesForDegeneration.clear();
-	degeneratedIndices.clear();
+	degenerationOrder.clear();
+	std::ranges::fill(aliveMask, 1.0);
 	degenerate = false;
 }
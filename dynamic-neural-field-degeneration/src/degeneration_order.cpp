@@ -0,0 +1,107 @@
+#include "degeneration_order.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "philox.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		void DegenerationOrder::reset(int numberOfCandidates)
+		{
+			order.resize(numberOfCandidates);
+			std::iota(order.begin(), order.end(), 0);
+			positionInOrder.resize(numberOfCandidates);
+			shuffle();
+			cursor = 0;
+		}
+
+		void DegenerationOrder::rewind()
+		{
+			cursor = 0;
+		}
+
+		void DegenerationOrder::clear()
+		{
+			order.clear();
+			positionInOrder.clear();
+			cursor = 0;
+		}
+
+		void DegenerationOrder::setSeed(std::uint64_t seed, std::uint64_t stream)
+		{
+			this->seed = seed;
+			this->stream = stream;
+			isSeeded = true;
+		}
+
+		int DegenerationOrder::next()
+		{
+			if (isExhausted())
+				return -1;
+			return order[cursor++];
+		}
+
+		std::span<const int> DegenerationOrder::takeFirst(int count)
+		{
+			cursor = std::clamp(count, 0, getNumberOfCandidates());
+			return getTaken();
+		}
+
+		bool DegenerationOrder::isTaken(int index) const
+		{
+			return positionInOrder[index] < cursor;
+		}
+
+		bool DegenerationOrder::isExhausted() const
+		{
+			return cursor >= getNumberOfCandidates();
+		}
+
+		int DegenerationOrder::getNumberOfCandidates() const
+		{
+			return static_cast<int>(order.size());
+		}
+
+		int DegenerationOrder::getNumberOfTaken() const
+		{
+			return cursor;
+		}
+
+		int DegenerationOrder::getNumberOfRemaining() const
+		{
+			return getNumberOfCandidates() - cursor;
+		}
+
+		std::span<const int> DegenerationOrder::getTaken() const
+		{
+			return { order.data(), static_cast<size_t>(cursor) };
+		}
+
+		std::uint64_t DegenerationOrder::getSeed() const
+		{
+			return seed;
+		}
+
+		std::uint64_t DegenerationOrder::getStream() const
+		{
+			return stream;
+		}
+
+		void DegenerationOrder::shuffle()
+		{
+			// Unseeded orders keep the previous behaviour of a fresh random order every trial.
+			if (!isSeeded)
+				seed = PhiloxGenerator::randomKey();
+
+			PhiloxGenerator generator(seed, stream);
+			for (int i = static_cast<int>(order.size()) - 1; i > 0; i--)
+				std::swap(order[i], order[generator.below(static_cast<std::uint64_t>(i) + 1)]);
+
+			for (int i = 0; i < static_cast<int>(order.size()); i++)
+				positionInOrder[order[i]] = i;
+		}
+	}
+}
@@ -11,6 +11,14 @@ namespace experiment
 			setIdentifiersFromType();
 		}
 
+		DegenerationParameters::DegenerationParameters(ElementDegeneracyType type, const std::string& field)
+		{
+			read();
+			this->type = type;
+			this->field = field;
+			setIdentifiersFromType();
+		}
+
 		void DegenerationParameters::read()
 		{
 			std::ifstream file(std::string(PROJECT_DIR) + "/experiment_parameters.json");
@@ -1,12 +1,15 @@
 
 #include "dnf_architecture.h"
 
-#include <elements/normal_noise.h>
 #include "degenerate_field_coupling.h"
 #include "degenerate_neural_field.h"
+#include "fft_gauss_kernel.h"
+#include "philox_normal_noise.h"
 #include "wizards/learning_wizard.h"
 
 constexpr bool trainWeights = false;
+constexpr double sigmoidXShift = 0.0;
+constexpr double sigmoidSteepness = 10.0;
 
 std::shared_ptr<dnf_composer::Simulation> getExperimentSimulation()
 {
@@ -19,13 +22,16 @@ std::shared_ptr<dnf_composer::Simulation> getExperimentSimulation()
 
 	// create neural field
 	//const dnf_composer::element::HeavisideFunction activationFunction{ 0 };
-	const dnf_composer::element::SigmoidFunction activationFunction{0.0, 10.0};
+	const dnf_composer::element::SigmoidFunction activationFunction{ sigmoidXShift, sigmoidSteepness };
 	const dnf_composer::element::NeuralFieldParameters nfp1 = { 25, -5 , activationFunction };
 	const dnf_composer::element::NeuralFieldParameters nfp2 = { 25, -5 , activationFunction };
 	const std::shared_ptr<DegenerateNeuralField> perceptual_field
 		(new DegenerateNeuralField({ "perceptual field", perceptualFieldSpatialDimensions}, nfp1));
 	const std::shared_ptr<DegenerateNeuralField> output_field
 		(new DegenerateNeuralField({ "output field", outputFieldSpatialDimensions }, nfp2));
+	// both fields compute their sigmoid output in the same sweep as the activation
+	perceptual_field->setSigmoidOutput(sigmoidXShift, sigmoidSteepness);
+	output_field->setSigmoidOutput(sigmoidXShift, sigmoidSteepness);
 
 	simulation->addElement(perceptual_field);
 	simulation->addElement(output_field);
@@ -37,8 +43,8 @@ std::shared_ptr<dnf_composer::Simulation> getExperimentSimulation()
 	gkp1.amplitudeGlobal = -0.12;
 	gkp1.circular = true;
 	gkp1.normalized = true;
-	const std::shared_ptr<dnf_composer::element::GaussKernel> k_per_per
-		(new dnf_composer::element::GaussKernel({ "per - per", perceptualFieldSpatialDimensions }, gkp1)); // self-excitation u-u
+	const std::shared_ptr<FftGaussKernel> k_per_per
+		(new FftGaussKernel({ "per - per", perceptualFieldSpatialDimensions }, gkp1)); // self-excitation u-u (FFT convolution on large fields)
 	simulation->addElement(k_per_per);
 
 	dnf_composer::element::GaussKernelParameters gkp2;
@@ -56,11 +62,11 @@ std::shared_ptr<dnf_composer::Simulation> getExperimentSimulation()
 		new DegenerateFieldCoupling({ "per - out", outputFieldSpatialDimensions }, fcp));
 	simulation->addElement(w_per_out);
 
-	// create noise stimulus and noise kernel
-	const std::shared_ptr<dnf_composer::element::NormalNoise> noise_per
-		(new dnf_composer::element::NormalNoise({ "noise per", perceptualFieldSpatialDimensions }, { 0.01}));
-	const std::shared_ptr<dnf_composer::element::NormalNoise> noise_out
-		(new dnf_composer::element::NormalNoise({ "noise out", outputFieldSpatialDimensions }, { 0.01 }));
+	// create noise stimulus and noise kernel (the noise streams are seeded per trial by the handler)
+	const std::shared_ptr<PhiloxNormalNoise> noise_per
+		(new PhiloxNormalNoise({ "noise per", perceptualFieldSpatialDimensions }, { 0.01}));
+	const std::shared_ptr<PhiloxNormalNoise> noise_out
+		(new PhiloxNormalNoise({ "noise out", outputFieldSpatialDimensions }, { 0.01 }));
 	const std::shared_ptr<dnf_composer::element::GaussKernel> noise_kernel_per
 		(new dnf_composer::element::GaussKernel({ "noise kernel per", perceptualFieldSpatialDimensions }, { 0.25, 0.02, 0.0 }));
 	const std::shared_ptr<dnf_composer::element::GaussKernel> noise_kernel_out
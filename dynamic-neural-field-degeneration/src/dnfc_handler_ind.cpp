@@ -1,9 +1,57 @@
 #include "dnfc_handler_ind.h"
 
+#include <bit>
+
 namespace experiment
 {
 	namespace degeneration
 	{
+		std::uint64_t getRandomStream(int trialIndex, RandomStream purpose)
+		{
+			return static_cast<std::uint64_t>(trialIndex) * static_cast<std::uint64_t>(RandomStream::COUNT) + static_cast<std::uint64_t>(purpose);
+		}
+
+		std::uint64_t getSettlingStream(double position, RandomStream purpose)
+		{
+			// Folds the bits of the position into a stream index that stays clear of the top bit.
+			const std::uint64_t positionBits = std::bit_cast<std::uint64_t>(position);
+			const std::uint64_t positionIndex = (positionBits ^ (positionBits >> 29)) & ((std::uint64_t{ 1 } << 59) - 1);
+			return (std::uint64_t{ 1 } << 63) | (positionIndex * static_cast<std::uint64_t>(RandomStream::COUNT) + static_cast<std::uint64_t>(purpose));
+		}
+
+		bool SettledStateStore::copyTo(double position, SimulationCheckpoint& checkpoint)
+		{
+			std::lock_guard lock(mutex);
+			const auto settledState = checkpoints.find(position);
+			if (settledState == checkpoints.end())
+				return false;
+			checkpoint.copyValuesFrom(settledState->second);
+			return true;
+		}
+
+		void SettledStateStore::add(double position, const SimulationCheckpoint& checkpoint)
+		{
+			std::lock_guard lock(mutex);
+			checkpoints.try_emplace(position, checkpoint);
+		}
+
+		void SettlingStatistics::add(const SettlingStatistics& other)
+		{
+			numberOfSettles += other.numberOfSettles;
+			numberOfSteps += other.numberOfSteps;
+			maxNumberOfSteps = std::max(maxNumberOfSteps, other.maxNumberOfSteps);
+		}
+
+		std::string SettlingStatistics::toString() const
+		{
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(2);
+			stream << numberOfSettles << " settles took " << numberOfSteps << " steps (mean of "
+				<< (numberOfSettles > 0 ? static_cast<double>(numberOfSteps) / static_cast<double>(numberOfSettles) : 0.0)
+				<< ", max of " << maxNumberOfSteps << ").";
+			return stream.str();
+		}
+
 		DnfcomposerHandlerInducing::DnfcomposerHandlerInducing()
 		{
 			simulation = getExperimentSimulation();
@@ -12,13 +60,16 @@ namespace experiment
 			simulationElements.inputField = std::dynamic_pointer_cast<DegenerateNeuralField>(simulation->getElement(simulationParameters.inputFieldId));
 			simulationElements.outputField = std::dynamic_pointer_cast<DegenerateNeuralField>(simulation->getElement(simulationParameters.outputFieldId));
 			simulationElements.fieldCoupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(simulation->getElement(simulationParameters.fieldCouplingId));
+			simulationElements.inputNoise = std::dynamic_pointer_cast<PhiloxNormalNoise>(simulation->getElement(simulationParameters.inputNoiseId));
+			simulationElements.outputNoise = std::dynamic_pointer_cast<PhiloxNormalNoise>(simulation->getElement(simulationParameters.outputNoiseId));
 
 			setupUserInterface();
 		}
 
-		DnfcomposerHandlerInducing::DnfcomposerHandlerInducing(bool isUserInterfaceActive)
+		DnfcomposerHandlerInducing::DnfcomposerHandlerInducing(bool isUserInterfaceActive, bool isHeadless)
 		{
-			simulationParameters.isUserInterfaceActive = isUserInterfaceActive;
+			simulationParameters.isUserInterfaceActive = isUserInterfaceActive && !isHeadless;
+			simulationParameters.isHeadless = isHeadless;
 
 			simulation = getExperimentSimulation();
 			application = std::make_unique<dnf_composer::Application>(simulation, simulationParameters.isUserInterfaceActive);
@@ -26,6 +77,8 @@ namespace experiment
 			simulationElements.inputField = std::dynamic_pointer_cast<DegenerateNeuralField>(simulation->getElement(simulationParameters.inputFieldId));
 			simulationElements.outputField = std::dynamic_pointer_cast<DegenerateNeuralField>(simulation->getElement(simulationParameters.outputFieldId));
 			simulationElements.fieldCoupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(simulation->getElement(simulationParameters.fieldCouplingId));
+			simulationElements.inputNoise = std::dynamic_pointer_cast<PhiloxNormalNoise>(simulation->getElement(simulationParameters.inputNoiseId));
+			simulationElements.outputNoise = std::dynamic_pointer_cast<PhiloxNormalNoise>(simulation->getElement(simulationParameters.outputNoiseId));
 
 			if (simulationParameters.isUserInterfaceActive)
 				setupUserInterface();
@@ -33,9 +86,14 @@ namespace experiment
 
 		void DnfcomposerHandlerInducing::init()
 		{
+			// In headless mode the experiment thread drives the simulation itself, one request at a time.
+			if (simulationParameters.isHeadless)
+			{
+				simulation->init();
+				return;
+			}
+
 			dnfcomposerThread = std::thread(&DnfcomposerHandlerInducing::step, this);
-			if (simulationParameters.isUserInterfaceActive)
-				readCentroidsThread = std::thread(&DnfcomposerHandlerInducing::updateFieldCentroids, this);
 		}
 
 		void DnfcomposerHandlerInducing::step()
@@ -43,16 +101,14 @@ namespace experiment
 			application->init();
 
 			bool userRequestClose = false;
-			while (!userRequestClose && !hasExperimentFinished)
+			while (!userRequestClose && !hasExperimentFinished.load(std::memory_order_acquire))
 			{
-				if (wasDegenerationRequested)
-					activateDegeneration();
-				else if (wasExternalInputUpdated)
-					updateExternalInput();
-				else if (hasTrialFinished)
-					cleanUpTrial();
-				else
-					application->step();
+				// Commands run between two steps; without one pending the simulation keeps stepping.
+				if (!commandChannel.tryExecute([this](const SimulationCommand& command) { executeCommand(command); }))
+				{
+					stepSimulation();
+					publishFieldCentroids();
+				}
 
 				if (simulationParameters.isUserInterfaceActive)
 					userRequestClose = application->hasUIBeenClosed();
@@ -64,31 +120,28 @@ namespace experiment
 
 		void DnfcomposerHandlerInducing::close()
 		{
+			if (simulationParameters.isHeadless)
+			{
+				simulation->close();
+				return;
+			}
+
 			dnfcomposerThread.join();
-			if (simulationParameters.isUserInterfaceActive)
-				readCentroidsThread.join();
 		}
 
 		void DnfcomposerHandlerInducing::stop()
 		{
-			hasExperimentFinished = true;
+			hasExperimentFinished.store(true, std::memory_order_release);
 		}
 
 		void DnfcomposerHandlerInducing::closeSimulation()
 		{
-			simulationElements.inputField->clearDegeneration();
-			simulationElements.outputField->clearDegeneration();
-			simulationElements.fieldCoupling->populateIndicesForDegeneration();
-			simulationElements.inputField->populateIndicesForDegeneration();
-			simulationElements.outputField->populateIndicesForDegeneration();
-			hasTrialFinished = true;
+			submitCommand({ .type = SimulationCommandType::CLEAN_UP_TRIAL });
 		}
 
 		void DnfcomposerHandlerInducing::setDegeneracy(ElementDegeneracyType degeneracyType, const std::string& fieldToDegenerate)
 		{
-			simulationParameters.degeneracyType = degeneracyType;
-			simulationParameters.fieldToDegenerate = fieldToDegenerate;
-			wasDegenerationRequested = true;
+			submitCommand({ .type = SimulationCommandType::APPLY_DEGENERATION, .degeneracyType = degeneracyType, .fieldToDegenerate = fieldToDegenerate });
 		}
 
 		void DnfcomposerHandlerInducing::setNumberOfElementsToDegenerate(int count)
@@ -98,15 +151,143 @@ namespace experiment
 			simulationElements.inputField->setNumNeuronsToDegenerate(numberOfElementsToDegenerate);
 		}
 
+		void DnfcomposerHandlerInducing::applyExperimentParameters(const ExperimentParameters& params)
+		{
+			setSettledStateCache(params.isSettledStateCacheOn, params.reseedNoiseOnRestore);
+			setAdaptiveSettling(params.isSettlingAdaptive, params.settlingTolerance, params.settlingStableSteps, params.maxTimeForFieldToSettle);
+			setDebugMode(params.isDebugModeOn);
+			setFastSigmoid(params.isFastSigmoidOn);
+			setSparseCouplingDensity(params.sparseCouplingDensity);
+			setIncrementalCoupling(params.isIncrementalCouplingOn, params.incrementalCouplingTolerance, params.incrementalCouplingResyncSteps);
+			setRandomSeed(params.randomSeed);
+		}
+
+		void DnfcomposerHandlerInducing::setSettledStateCache(bool isSettledStateCacheOn, bool reseedNoiseOnRestore)
+		{
+			simulationParameters.isSettledStateCacheOn = isSettledStateCacheOn;
+			simulationParameters.reseedNoiseOnRestore = reseedNoiseOnRestore;
+			settledStateCheckpoints.clear();
+		}
+
+		void DnfcomposerHandlerInducing::setSharedSettledStates(std::shared_ptr<SettledStateStore> sharedSettledStates)
+		{
+			this->sharedSettledStates = std::move(sharedSettledStates);
+		}
+
+		void DnfcomposerHandlerInducing::setAdaptiveSettling(bool isSettlingAdaptive, double tolerance, int stableSteps, int maxSteps)
+		{
+			simulationParameters.isSettlingAdaptive = isSettlingAdaptive;
+			simulationParameters.settlingTolerance = tolerance;
+			simulationParameters.settlingStableSteps = stableSteps;
+			simulationParameters.maxTimeForFieldToSettle = maxSteps;
+		}
+
+		void DnfcomposerHandlerInducing::setDebugMode(bool isDebugMode)
+		{
+			simulationParameters.isDebugMode = isDebugMode;
+		}
+
+		void DnfcomposerHandlerInducing::setFastSigmoid(bool isFastSigmoidOn)
+		{
+			simulationElements.inputField->setFastSigmoid(isFastSigmoidOn);
+			simulationElements.outputField->setFastSigmoid(isFastSigmoidOn);
+		}
+
+		void DnfcomposerHandlerInducing::setSparseCouplingDensity(double density)
+		{
+			simulationElements.fieldCoupling->setSparseDensityThreshold(density);
+		}
+
+		void DnfcomposerHandlerInducing::setIncrementalCoupling(bool isIncrementalCouplingOn, double inputTolerance, int resyncSteps)
+		{
+			simulationElements.fieldCoupling->setIncrementalOutput(isIncrementalCouplingOn, inputTolerance, resyncSteps);
+		}
+
+		void DnfcomposerHandlerInducing::setRandomSeed(std::uint64_t seed)
+		{
+			simulationParameters.randomSeed = seed;
+		}
+
 		void DnfcomposerHandlerInducing::setExternalInput(const double& position)
 		{
-			simulationParameters.externalInputPosition = position;
-			wasExternalInputUpdated = true;
+			submitCommand({ .type = SimulationCommandType::SET_EXTERNAL_INPUT, .externalInputPosition = position });
+		}
+
+		void DnfcomposerHandlerInducing::startTrial(int trialIndex)
+		{
+			submitCommand({ .type = SimulationCommandType::START_TRIAL, .trialIndex = trialIndex });
+		}
+
+		void DnfcomposerHandlerInducing::waitForPendingCommands()
+		{
+			// Headless commands already ran inline; otherwise block (without spinning) until the simulation thread is done.
+			if (!simulationParameters.isHeadless)
+				commandChannel.waitForAll();
+		}
+
+		void DnfcomposerHandlerInducing::submitCommand(SimulationCommand command)
+		{
+			if (simulationParameters.isHeadless)
+				executeCommand(command);
+			else
+				commandChannel.push(std::move(command));
+		}
+
+		void DnfcomposerHandlerInducing::executeCommand(const SimulationCommand& command)
+		{
+			switch (command.type)
+			{
+			case SimulationCommandType::SET_EXTERNAL_INPUT:
+				simulationParameters.externalInputPosition = command.externalInputPosition;
+				updateExternalInput();
+				break;
+			case SimulationCommandType::APPLY_DEGENERATION:
+				simulationParameters.degeneracyType = command.degeneracyType;
+				simulationParameters.fieldToDegenerate = command.fieldToDegenerate;
+				activateDegeneration();
+				break;
+			case SimulationCommandType::CLEAN_UP_TRIAL:
+				cleanUpTrial();
+				break;
+			case SimulationCommandType::START_TRIAL:
+				seedTrial(command.trialIndex);
+				break;
+			}
+
+			// Published before the completion is signalled, so the waiting experiment thread reads the settled state.
+			if (!simulationParameters.isHeadless)
+				publishFieldCentroids();
+		}
+
+		void DnfcomposerHandlerInducing::seedTrial(int trialIndex)
+		{
+			// Degeneration orders, random weight values and noise of a trial come from their own streams,
+			// so the trial does not depend on what ran before it (on this handler or on any other).
+			const auto stream = [trialIndex](RandomStream purpose) { return getRandomStream(trialIndex, purpose); };
+			const std::uint64_t seed = simulationParameters.randomSeed;
+
+			simulationElements.inputField->setDegenerationSeed(seed, stream(RandomStream::PERCEPTUAL_FIELD_ORDER));
+			simulationElements.outputField->setDegenerationSeed(seed, stream(RandomStream::OUTPUT_FIELD_ORDER));
+			simulationElements.fieldCoupling->setDegenerationSeed(seed, stream(RandomStream::COUPLING_ORDER), stream(RandomStream::COUPLING_VALUES));
+			cleanUpTrial();
+
+			this->trialIndex = trialIndex;
+			seedNoise();
+		}
+
+		void DnfcomposerHandlerInducing::seedNoise()
+		{
+			const std::uint64_t seed = simulationParameters.randomSeed;
+			simulationElements.inputNoise->setStream(seed, getRandomStream(trialIndex, RandomStream::PERCEPTUAL_NOISE));
+			simulationElements.outputNoise->setStream(seed, getRandomStream(trialIndex, RandomStream::OUTPUT_NOISE));
 		}
 
-		void DnfcomposerHandlerInducing::setHaveFieldsSettled(bool haveFieldsSettled)
+		void DnfcomposerHandlerInducing::seedSettlingNoise()
 		{
-			this->haveFieldsSettled = haveFieldsSettled;
+			const std::uint64_t seed = simulationParameters.randomSeed;
+			const double position = simulationParameters.externalInputPosition;
+			simulationElements.inputNoise->setStream(seed, getSettlingStream(position, RandomStream::PERCEPTUAL_NOISE));
+			simulationElements.outputNoise->setStream(seed, getSettlingStream(position, RandomStream::OUTPUT_NOISE));
 		}
 
 		void DnfcomposerHandlerInducing::setIsUserInterfaceActiveAs(bool isUserInterfaceActive) const
@@ -116,25 +297,51 @@ namespace experiment
 
 		double DnfcomposerHandlerInducing::getInputFieldCentroid() const
 		{
-			if (!simulationParameters.isUserInterfaceActive)
-			{
+			// Headless handlers are stepped by the calling thread, so the fields can be read directly.
+			if (simulationParameters.isHeadless)
 				return simulationElements.inputField->getCentroid();
-			}
-			return simulationParameters.inputFieldCentroid;
+			return publishedCentroids.read().inputFieldCentroid;
 		}
 
 		double DnfcomposerHandlerInducing::getOutputFieldCentroid() const
 		{
-			if (!simulationParameters.isUserInterfaceActive)
-			{
+			if (simulationParameters.isHeadless)
 				return simulationElements.outputField->getCentroid();
-			}
-			return simulationParameters.outputFieldCentroid;
+			return publishedCentroids.read().outputFieldCentroid;
+		}
+
+		CentroidHistory DnfcomposerHandlerInducing::createOutputFieldCentroidHistory() const
+		{
+			// At most every neuron of the output field is active, which bounds the denominators of the centroids.
+			const auto numberOfNeurons = static_cast<int>(simulationElements.outputField->getComponentPtr("activation")->size());
+			return { simulationElements.outputField->getStepSize(), numberOfNeurons };
+		}
+
+		FieldCentroids DnfcomposerHandlerInducing::getFieldCentroids() const
+		{
+			if (simulationParameters.isHeadless)
+				return { simulationElements.inputField->getCentroid(), simulationElements.outputField->getCentroid(), numberOfSimulationSteps };
+			return publishedCentroids.read();
+		}
+
+		CommandLatencyStatistics DnfcomposerHandlerInducing::getCommandLatencyStatistics() const
+		{
+			return commandChannel.getLatencyStatistics();
+		}
+
+		bool DnfcomposerHandlerInducing::isHeadless() const
+		{
+			return simulationParameters.isHeadless;
+		}
+
+		std::uint64_t DnfcomposerHandlerInducing::getNumberOfSimulationSteps() const
+		{
+			return numberOfSimulationSteps;
 		}
 
-		bool DnfcomposerHandlerInducing::getHaveFieldsSettled() const
+		const SettlingStatistics& DnfcomposerHandlerInducing::getSettlingStatistics() const
 		{
-			return haveFieldsSettled;
+			return settlingStatistics;
 		}
 
 		std::shared_ptr<ExperimentWindow> DnfcomposerHandlerInducing::getUserInterfaceWindow()
@@ -142,10 +349,19 @@ namespace experiment
 			return userInterfaceWindow;
 		}
 
+		std::shared_ptr<dnf_composer::Simulation> DnfcomposerHandlerInducing::getSimulation() const
+		{
+			return simulation;
+		}
+
+		const SimulationParameters& DnfcomposerHandlerInducing::getSimulationParameters() const
+		{
+			return simulationParameters;
+		}
+
 		void DnfcomposerHandlerInducing::initializeFields()
 		{
 			simulation->init();
-			wasIntializationRequested = false;
 		}
 
 		void DnfcomposerHandlerInducing::setupUserInterface()
@@ -180,26 +396,29 @@ namespace experiment
 
 		void DnfcomposerHandlerInducing::cleanUpTrial()
 		{
+			simulationElements.inputField->clearDegeneration();
+			simulationElements.outputField->clearDegeneration();
+			simulationElements.fieldCoupling->populateIndicesForDegeneration();
+			simulationElements.inputField->populateIndicesForDegeneration();
+			simulationElements.outputField->populateIndicesForDegeneration();
 			numberOfDegeneratedElements = 0;
-			hasTrialFinished = false;
 		}
 
 		void DnfcomposerHandlerInducing::updateExternalInput()
 		{
-			initializeFields();
-
-			Sleep(100);
+			if (restoreSettledState())
+				return;
 
-			static auto kernel = std::dynamic_pointer_cast<dnf_composer::element::GaussKernel>(simulation->getElement("per - per"));
-			static auto kernel_width = kernel->getParameters().width;
-			static auto kernel_amplitude = kernel->getParameters().amplitude;
+			initializeFields();
+			// A state that is cached settles from the noise streams of its position, not of the trial that
+			// happens to settle it first; the trial then goes on as if the state had been restored.
+			if (simulationParameters.isSettledStateCacheOn)
+				seedSettlingNoise();
 
-			static double offset = 0.0;
-			dnf_composer::element::GaussStimulusParameters gsp = { kernel_width, kernel_amplitude, 20 };
-			gsp.position = simulationParameters.externalInputPosition + offset;
-			const std::shared_ptr<dnf_composer::element::GaussStimulus> stimulus
-			(new dnf_composer::element::GaussStimulus({ "stimulus", {simulationElements.inputField->getMaxSpatialDimension(), simulationElements.inputField->getStepSize()} }, gsp));
+			if (!simulationParameters.isHeadless)
+				Sleep(100);
 
+			const std::shared_ptr<dnf_composer::element::GaussStimulus> stimulus = createExternalInput(simulationParameters.externalInputPosition);
 			simulation->addElement(stimulus);
 			stimulus->init();
 			simulationElements.inputField->addInput(stimulus);
@@ -207,23 +426,186 @@ namespace experiment
 
 			simulation->removeElement("stimulus");
 			waitForFieldsToSettle();
+			captureSettledState();
+		}
 
-			haveFieldsSettled = true;
-			wasExternalInputUpdated = false;
+		std::shared_ptr<dnf_composer::element::GaussStimulus> DnfcomposerHandlerInducing::createExternalInput(double position) const
+		{
+			// Not static: several handlers (one per worker thread) may exist at once.
+			const auto kernel = std::dynamic_pointer_cast<dnf_composer::element::GaussKernel>(simulation->getElement("per - per"));
+			const auto kernel_width = kernel->getParameters().width;
+			const auto kernel_amplitude = kernel->getParameters().amplitude;
+
+			constexpr double offset = 0.0;
+			dnf_composer::element::GaussStimulusParameters gsp = { kernel_width, kernel_amplitude, 20 };
+			gsp.position = position + offset;
+			return std::shared_ptr<dnf_composer::element::GaussStimulus>
+				(new dnf_composer::element::GaussStimulus({ "stimulus", {simulationElements.inputField->getMaxSpatialDimension(), simulationElements.inputField->getStepSize()} }, gsp));
 		}
 
-		void DnfcomposerHandlerInducing::updateFieldCentroids()
+		bool DnfcomposerHandlerInducing::restoreSettledState()
 		{
-			bool userRequestClose = false;
-			while (!userRequestClose && !hasExperimentFinished)
+			if (!simulationParameters.isSettledStateCacheOn)
+				return false;
+
+			const double position = simulationParameters.externalInputPosition;
+			auto checkpoint = settledStateCheckpoints.find(position);
+			if (checkpoint == settledStateCheckpoints.end())
 			{
-				simulationParameters.inputFieldCentroid = simulationElements.inputField->getCentroid();
-				simulationParameters.outputFieldCentroid = simulationElements.outputField->getCentroid();
+				SimulationCheckpoint sharedCheckpoint = createCheckpoint();
+				if (!sharedSettledStates || !sharedSettledStates->copyTo(position, sharedCheckpoint))
+					return false;
+				checkpoint = settledStateCheckpoints.emplace(position, std::move(sharedCheckpoint)).first;
+			}
 
-				if (simulationParameters.isUserInterfaceActive)
-					userRequestClose = application->hasUIBeenClosed();
-				Sleep(1);
+			// The degeneration bookkeeping was already reset by closeSimulation() at the end of the previous trial.
+			// The noise restarts at the first sample of this trial's streams, whatever the noise elements drew
+			// before the restore; the checkpoint only holds the last noise drawn while settling, if anything.
+			checkpoint->second.restore();
+			seedNoise();
+			return true;
+		}
+
+		void DnfcomposerHandlerInducing::captureSettledState()
+		{
+			if (!simulationParameters.isSettledStateCacheOn)
+				return;
+
+			SimulationCheckpoint checkpoint = createCheckpoint();
+			checkpoint.capture();
+			if (sharedSettledStates)
+				sharedSettledStates->add(simulationParameters.externalInputPosition, checkpoint);
+			settledStateCheckpoints[simulationParameters.externalInputPosition] = std::move(checkpoint);
+			seedNoise();
+		}
+
+		SimulationCheckpoint DnfcomposerHandlerInducing::createCheckpoint() const
+		{
+			SimulationCheckpoint checkpoint;
+			for (const auto& field : { simulationElements.inputField, simulationElements.outputField })
+				for (const auto& component : { "activation", "input", "output" })
+					checkpoint.addComponent(field, component);
+			for (const auto& kernel : { "per - per", "out - out" })
+				for (const auto& component : { "input", "output" })
+					checkpoint.addComponent(simulation->getElement(kernel), component);
+			for (const auto& component : { "input", "output" })
+				checkpoint.addComponent(simulationElements.fieldCoupling, component);
+
+			// Without reseeding, the last noise drawn while settling is restored too; otherwise the noise elements
+			// only draw from this trial's streams, which restoreSettledState() always reseeds.
+			if (!simulationParameters.reseedNoiseOnRestore)
+			{
+				for (const auto& noise : { "noise per", "noise out" })
+					checkpoint.addComponent(simulation->getElement(noise), "output");
+				for (const auto& noiseKernel : { "noise kernel per", "noise kernel out" })
+					for (const auto& component : { "input", "output" })
+						checkpoint.addComponent(simulation->getElement(noiseKernel), component);
 			}
+
+			checkpoint.addFieldCoupling(simulationElements.fieldCoupling);
+			return checkpoint;
+		}
+
+		DegenerationThreshold DnfcomposerHandlerInducing::findDegenerationThreshold(ElementDegeneracyType degeneracyType,
+			const std::string& fieldToDegenerate, double targetOutputFieldCentroid, double decisionTolerance)
+		{
+			// Bisection on the number of degenerated elements of this trial's (fixed) degeneration order.
+			// Every probe restores the settled state, jumps to the first k degenerated elements and settles,
+			// so the search needs O(log n) settles instead of one settle per degeneration increment.
+			simulationParameters.degeneracyType = degeneracyType;
+			simulationParameters.fieldToDegenerate = fieldToDegenerate;
+			simulationElements.inputField->setDegeneracyType(degeneracyType);
+			simulationElements.outputField->setDegeneracyType(degeneracyType);
+			simulationElements.fieldCoupling->setDegeneracyType(degeneracyType);
+
+			SimulationCheckpoint checkpoint = createCheckpoint();
+			checkpoint.capture();
+
+			DegenerationThreshold threshold;
+			switch (degeneracyType)
+			{
+			case ElementDegeneracyType::NEURONS_DEACTIVATE:
+				threshold.numberOfCandidates = fieldToDegenerate == "perceptual" ?
+					simulationElements.inputField->getNumberOfCandidatesForDegeneration() : simulationElements.outputField->getNumberOfCandidatesForDegeneration();
+				break;
+			case ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+			case ElementDegeneracyType::WEIGHTS_RANDOMIZE:
+			case ElementDegeneracyType::WEIGHTS_REDUCE:
+				threshold.numberOfCandidates = simulationElements.fieldCoupling->getNumberOfCandidatesForDegeneration();
+				break;
+			default:
+				break;
+			}
+
+			const double outputFieldRange = simulationElements.outputField->getMaxSpatialDimension();
+			const auto hasFailed = [&](double centroid)
+				{
+					if (centroid < 0)
+						return true;
+					const double deviation = std::abs(centroid - targetOutputFieldCentroid);
+					return std::min(deviation, outputFieldRange - deviation) > decisionTolerance;
+				};
+
+			// Invariant: the output is healthy with low elements degenerated and has failed with high.
+			int low = 0, high = threshold.numberOfCandidates + 1;
+			double centroidAtLow = settleWithFirstDegenerated(checkpoint, 0);
+			double centroidAtHigh = -1;
+			threshold.numberOfSettles++;
+			if (hasFailed(centroidAtLow))
+			{
+				high = 0;
+				centroidAtHigh = centroidAtLow;
+			}
+
+			while (high - low > 1)
+			{
+				const int middle = low + (high - low) / 2;
+				const double centroid = settleWithFirstDegenerated(checkpoint, middle);
+				threshold.numberOfSettles++;
+				if (hasFailed(centroid))
+				{
+					high = middle;
+					centroidAtHigh = centroid;
+				}
+				else
+				{
+					low = middle;
+					centroidAtLow = centroid;
+				}
+			}
+
+			threshold.numberOfElements = high;
+			threshold.outputFieldCentroid = centroidAtHigh;
+			threshold.outputFieldCentroidBeforeThreshold = high > 0 ? centroidAtLow : -1;
+			numberOfDegeneratedElements = std::min(high, threshold.numberOfCandidates);
+
+			if (simulationParameters.isDebugMode)
+				std::cout << "Degeneration threshold of " << threshold.numberOfElements << "/" << threshold.numberOfCandidates
+					<< " elements found after " << threshold.numberOfSettles << " settles." << std::endl;
+			return threshold;
+		}
+
+		double DnfcomposerHandlerInducing::settleWithFirstDegenerated(const SimulationCheckpoint& checkpoint, int count)
+		{
+			checkpoint.restore();
+			switch (simulationParameters.degeneracyType)
+			{
+			case ElementDegeneracyType::NEURONS_DEACTIVATE:
+				if (simulationParameters.fieldToDegenerate == "perceptual")
+					simulationElements.inputField->degenerateFirst(count);
+				else
+					simulationElements.outputField->degenerateFirst(count);
+				break;
+			case ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+			case ElementDegeneracyType::WEIGHTS_RANDOMIZE:
+			case ElementDegeneracyType::WEIGHTS_REDUCE:
+				simulationElements.fieldCoupling->degenerateFirst(count);
+				break;
+			default:
+				break;
+			}
+			waitForFieldsToSettle();
+			return simulationElements.outputField->getCentroid();
 		}
 
 		void DnfcomposerHandlerInducing::activateDegeneration()
@@ -260,15 +642,67 @@ namespace experiment
 			}
 
 			waitForFieldsToSettle();
+		}
 
-			haveFieldsSettled = true;
-			wasDegenerationRequested = false;
+		void DnfcomposerHandlerInducing::waitForFieldsToSettle()
+		{
+			int numberOfSteps = simulationParameters.timeForFieldToSettle;
+			if (simulationParameters.isSettlingAdaptive)
+				numberOfSteps = settleAdaptively();
+			else
+				for (int i = 0; i < numberOfSteps; i++)
+					stepSimulation();
+
+			settlingStatistics.numberOfSettles++;
+			settlingStatistics.numberOfSteps += numberOfSteps;
+			settlingStatistics.maxNumberOfSteps = std::max(settlingStatistics.maxNumberOfSteps, numberOfSteps);
+			if (simulationParameters.isDebugMode)
+				std::cout << "Fields settled after " << numberOfSteps << " steps." << std::endl;
+		}
+
+		int DnfcomposerHandlerInducing::settleAdaptively()
+		{
+			const std::vector<double>& inputFieldActivation = *simulationElements.inputField->getComponentPtr("activation");
+			const std::vector<double>& outputFieldActivation = *simulationElements.outputField->getComponentPtr("activation");
+
+			const auto maxAbsChange = [](const std::vector<double>& current, std::vector<double>& previous)
+				{
+					double change = 0.0;
+					for (size_t i = 0; i < current.size(); i++)
+						change = std::max(change, std::fabs(current[i] - previous[i]));
+					std::ranges::copy(current, previous.begin());
+					return change;
+				};
+
+			previousInputFieldActivation.assign(inputFieldActivation.begin(), inputFieldActivation.end());
+			previousOutputFieldActivation.assign(outputFieldActivation.begin(), outputFieldActivation.end());
+
+			int numberOfSteps = 0;
+			int numberOfStableSteps = 0;
+			while (numberOfSteps < simulationParameters.maxTimeForFieldToSettle && numberOfStableSteps < simulationParameters.settlingStableSteps)
+			{
+				stepSimulation();
+				numberOfSteps++;
+
+				const double change = std::max(maxAbsChange(inputFieldActivation, previousInputFieldActivation),
+					maxAbsChange(outputFieldActivation, previousOutputFieldActivation));
+				numberOfStableSteps = change < simulationParameters.settlingTolerance ? numberOfStableSteps + 1 : 0;
+			}
+			return numberOfSteps;
 		}
 
-		void DnfcomposerHandlerInducing::waitForFieldsToSettle() const
+		void DnfcomposerHandlerInducing::stepSimulation()
 		{
-			for (int i = 0; i < simulationParameters.timeForFieldToSettle; i++)
+			if (simulationParameters.isHeadless)
+				simulation->step();
+			else
 				application->step();
+			numberOfSimulationSteps++;
+		}
+
+		void DnfcomposerHandlerInducing::publishFieldCentroids()
+		{
+			publishedCentroids.publish({ simulationElements.inputField->getCentroid(), simulationElements.outputField->getCentroid(), numberOfSimulationSteps });
 		}
 	}
 }
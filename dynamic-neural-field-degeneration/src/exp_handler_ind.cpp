@@ -5,9 +5,9 @@ namespace experiment
 	namespace degeneration
 	{
 		ExperimentHandlerInducing::ExperimentHandlerInducing()
-			: params(), dnfcomposerHandler(params.isVisualizationOn)
+			: params(), dnfcomposerHandler(params.isVisualizationOn, params.isHeadlessModeOn), resultsWriter(static_cast<std::size_t>(std::max(params.resultsQueueCapacity, 1)))
 		{
-			data.outputFieldCentroidHistory.reserve(60000);
+			data.outputFieldCentroidHistory = dnfcomposerHandler.createOutputFieldCentroidHistory();
 			std::advance(hueToAngleIterator, params.startingExternalStimulus);
 			readHueToAngleMap();
 		}
@@ -32,47 +32,127 @@ namespace experiment
 		void ExperimentHandlerInducing::init()
 		{
 			dnfcomposerHandler.init();
-			experimentThread = std::thread(&ExperimentHandlerInducing::step, this);
+			// Headless runs are driven synchronously from the calling thread.
+			if (params.isHeadlessModeOn)
+				step();
+			else
+				experimentThread = std::thread(&ExperimentHandlerInducing::step, this);
 		}
 
 		void ExperimentHandlerInducing::setExperimentSetupData()
 		{
 			dnfcomposerHandler.setNumberOfElementsToDegenerate(params.degenerationParameters.numberOfElementsToDegeneratePerIteration);
+			dnfcomposerHandler.applyExperimentParameters(params);
 		}
 
 		void ExperimentHandlerInducing::step()
 		{
 			params.print();
-			setExperimentSetupData();
+			if (params.isDataSavingOn)
+				resultsWriter.start();
+			const auto startTime = std::chrono::steady_clock::now();
+			std::uint64_t numberOfSteps;
 
-			for (int i = 0; i < params.numberOfTrials; i++)
+			// Parallel and batched workers own private headless simulations, so they need the headless mode.
+			// The ablation scan runs its trials in series and parallelizes each scan instead.
+			if (params.isHeadlessModeOn && !params.isAblationScanOn && (params.numberOfThreads != 1 || params.batchSize > 1))
 			{
-				params.currentTrial = i + 1;
-				if (params.isDebugModeOn)
+				runTrialsInParallel();
+				numberOfSteps = dnfcomposerHandler.getNumberOfSimulationSteps() + trialSchedulerSteps;
+			}
+			else
+			{
+				runTrialsInSeries();
+				numberOfSteps = dnfcomposerHandler.getNumberOfSimulationSteps();
+			}
+
+			// Waits for the queued results and syncs the files before the experiment is reported as ended.
+			resultsWriter.close();
+			logThroughput(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count(), numberOfSteps);
+			setExperimentAsEnded();
+		}
+
+		void ExperimentHandlerInducing::runTrialsInSeries()
+		{
+			// Trials are numbered like the work items of a parallel run, so both draw the same random streams.
+			int trialIndex = 0;
+			for (const auto& degenerationParameters : params.degenerationSweep)
+			{
+				params.degenerationParameters = degenerationParameters;
+				setExperimentSetupData();
+
+				for (int i = 0; i < params.numberOfTrials; i++)
 				{
-					std::string message = "Starting trial " + std::to_string(params.currentTrial) + " out of " + std::to_string(params.numberOfTrials) + ". ";
-					message += "External stimulus: " + std::to_string(data.targetInputFieldCentroid) + ". ";
-					message += "Expected input field centroid: " + std::to_string(data.targetInputFieldCentroid) + ". ";
-					message += "Expected output field centroid: " + std::to_string(data.targetOutputFieldCentroid) + ".";
-					dnf_composer::tools::logger::log(dnf_composer::tools::logger::LogLevel::INFO, message);
+					params.currentTrial = i + 1;
+					if (params.isDebugModeOn)
+					{
+						std::string message = "Starting trial " + std::to_string(params.currentTrial) + " out of " + std::to_string(params.numberOfTrials) + ". ";
+						message += "External stimulus: " + std::to_string(data.targetInputFieldCentroid) + ". ";
+						message += "Expected input field centroid: " + std::to_string(data.targetInputFieldCentroid) + ". ";
+						message += "Expected output field centroid: " + std::to_string(data.targetOutputFieldCentroid) + ".";
+						dnf_composer::tools::logger::log(dnf_composer::tools::logger::LogLevel::INFO, message);
+					}
+
+					for (int k = 0; k < static_cast<int>(hueToAngleMap.size()); k++)
+					{
+						setExpectedFieldBehaviour();
+						data.trialIndex = trialIndex++;
+						dnfcomposerHandler.startTrial(data.trialIndex);
+						setupProcedure();
+						if (params.isThresholdModeOn)
+							thresholdProcedure();
+						else if (params.isAblationScanOn)
+							ablationScanProcedure();
+						else
+							degenerationProcedure();
+						cleanUpTrial();
+						waitFor(20);
+					}
+					waitFor(50);
 				}
+			}
+		}
 
-				for (int k = 0; k < static_cast<int>(hueToAngleMap.size()); k++)
+		void ExperimentHandlerInducing::runTrialsInParallel()
+		{
+			// Work items are enumerated in the order of a serial run, which is also the order results are saved in.
+			TrialScheduler scheduler(params);
+			int trialIndex = 0;
+			for (const auto& degenerationParameters : params.degenerationSweep)
+			{
+				for (int i = 0; i < params.numberOfTrials; i++)
 				{
-					setExpectedFieldBehaviour();
-					setupProcedure();
-					degenerationProcedure();
-					cleanUpTrial();
-					Sleep(20);
+					for (int k = 0; k < static_cast<int>(hueToAngleMap.size()); k++)
+					{
+						setExpectedFieldBehaviour();
+						scheduler.addWorkItem({ degenerationParameters, i + 1, data.targetInputFieldCentroid, data.targetOutputFieldCentroid, trialIndex++ });
+					}
 				}
-				Sleep(50);
 			}
-			setExperimentAsEnded();
+
+			if (params.isDebugModeOn)
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO,
+					"Running trials on " + std::to_string(scheduler.getNumberOfWorkers()) + " worker threads.");
+
+			scheduler.run([this](const TrialResult& result)
+				{
+					if (!params.isDataSavingOn)
+						return;
+					if (params.isThresholdModeOn)
+						saveDegenerationThresholdToFile(result.workItem.degenerationParameters, result.workItem.targetOutputFieldCentroid,
+							result.threshold);
+					else
+						saveOutputFieldCentroidToFile(result.workItem.degenerationParameters, result.workItem.targetOutputFieldCentroid,
+							result.workItem.trial, result.workItem.trialIndex, result.outputFieldCentroidHistory);
+				});
+			trialSchedulerSteps = scheduler.getNumberOfSimulationSteps();
+			trialSchedulerSettlingStatistics = scheduler.getSettlingStatistics();
 		}
 
 		void ExperimentHandlerInducing::close()
 		{
-			experimentThread.join();
+			if (experimentThread.joinable())
+				experimentThread.join();
 			dnfcomposerHandler.close();
 		}
 
@@ -84,8 +164,7 @@ namespace experiment
 			if (params.isDebugModeOn)
 				dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO, "Added gaussian stimulus to perceptual field.");
 
-			while (!dnfcomposerHandler.getHaveFieldsSettled());
-			dnfcomposerHandler.setHaveFieldsSettled(false);
+			dnfcomposerHandler.waitForPendingCommands();
 		}
 
 		void ExperimentHandlerInducing::degenerationProcedure()
@@ -95,7 +174,7 @@ namespace experiment
 			while (!isOutputFieldDegenerated)
 			{
 				// save centroid of the output field
-				Sleep(2);
+				waitFor(2);
 				data.outputFieldCentroidHistory.push_back(dnfcomposerHandler.getOutputFieldCentroid());
 
 				// apply degeneration and wait for the fields to settle
@@ -116,13 +195,16 @@ namespace experiment
 						return std::min(diff, range - diff);
 						};
 
+					// Both centroids come from the same snapshot
+					const FieldCentroids centroids = dnfcomposerHandler.getFieldCentroids();
+
 					// Perceptual field (range 0-360)
-					const double perceptualCentroid = dnfcomposerHandler.getInputFieldCentroid();
+					const double perceptualCentroid = centroids.inputFieldCentroid;
 					const double targetPerceptualCentroid = data.targetInputFieldCentroid;
 					const double perceptualDeviation = circularDeviation(perceptualCentroid, targetPerceptualCentroid, 360.0);
 
 					// Output field (range 0-28)
-					const double outputCentroid = dnfcomposerHandler.getOutputFieldCentroid();
+					const double outputCentroid = centroids.outputFieldCentroid;
 					const double targetOutputCentroid = data.targetOutputFieldCentroid;
 					const double outputDeviation = circularDeviation(outputCentroid, targetOutputCentroid, 28.0);
 
@@ -136,23 +218,107 @@ namespace experiment
 					log(dnf_composer::tools::logger::INFO, message);
 				}
 
-				while (!dnfcomposerHandler.getHaveFieldsSettled());
-
-				dnfcomposerHandler.setHaveFieldsSettled(false);
+				dnfcomposerHandler.waitForPendingCommands();
 
 				isOutputFieldDegenerated = hasOutputFieldDegenerated();
 			}
 		}
 
+		void ExperimentHandlerInducing::thresholdProcedure()
+		{
+			// Bisect the failure point instead of degenerating one increment at a time.
+			data.degenerationThreshold = dnfcomposerHandler.findDegenerationThreshold(params.degenerationParameters.type,
+				params.degenerationParameters.field, data.targetOutputFieldCentroid, params.decisionTolerance);
+
+			if (params.isDebugModeOn)
+			{
+				std::string message = "Trial: " + std::to_string(params.currentTrial) + ". ";
+				message += "Output field failed with " + std::to_string(data.degenerationThreshold.numberOfElements) + "/"
+					+ std::to_string(data.degenerationThreshold.numberOfCandidates) + " degenerated " + params.degenerationParameters.name
+					+ " (" + std::to_string(data.degenerationThreshold.numberOfSettles) + " settles).";
+				log(dnf_composer::tools::logger::INFO, message);
+			}
+		}
+
+		void ExperimentHandlerInducing::ablationScanProcedure()
+		{
+			// The fields settled on the stimulus in setupProcedure(); every single element is removed from that state.
+			AblationTarget target;
+			switch (params.degenerationParameters.type)
+			{
+			case ElementDegeneracyType::NEURONS_DEACTIVATE:
+				target = params.degenerationParameters.field == "perceptual" ? AblationTarget::PRESYNAPTIC_NEURONS : AblationTarget::POSTSYNAPTIC_NEURONS;
+				break;
+			case ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+				target = AblationTarget::WEIGHTS;
+				break;
+			default:
+				data.ablationSensitivityMap = {};
+				log(dnf_composer::tools::logger::ERROR, "Ablation scans remove elements, " + params.degenerationParameters.name + " is not supported.");
+				return;
+			}
+
+			const auto startTime = std::chrono::steady_clock::now();
+			const AblationScan scan(dnfcomposerHandler.getSimulation(), dnfcomposerHandler.getSimulationParameters().timeForFieldToSettle, params.numberOfThreads);
+			data.ablationSensitivityMap = scan.scan(target);
+
+			if (params.isDebugModeOn)
+			{
+				const auto& centroids = data.ablationSensitivityMap.outputFieldCentroids;
+				const auto numberOfFailures = std::count(centroids.begin(), centroids.end(), -1.0);
+				std::ostringstream stream;
+				stream << std::fixed << std::setprecision(2);
+				stream << "Trial: " << params.currentTrial << ". Scanned " << centroids.size() << " single " << params.degenerationParameters.name
+					<< " ablations in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() << " s. "
+					<< "Output field centroid is " << data.ablationSensitivityMap.baselineOutputFieldCentroid << " without ablation, "
+					<< numberOfFailures << " ablations remove the peak.";
+				log(dnf_composer::tools::logger::INFO, stream.str());
+			}
+		}
+
 		void ExperimentHandlerInducing::cleanUpTrial()
 		{
 			if (params.isDataSavingOn)
-				saveOutputFieldCentroidToFile();
-			Sleep(20);
+			{
+				if (params.isThresholdModeOn)
+					saveDegenerationThresholdToFile(params.degenerationParameters, data.targetOutputFieldCentroid, data.degenerationThreshold);
+				else if (params.isAblationScanOn)
+					saveAblationSensitivityMapToFile(params.degenerationParameters, data.targetOutputFieldCentroid, data.ablationSensitivityMap);
+				else
+					saveOutputFieldCentroidToFile(params.degenerationParameters, data.targetOutputFieldCentroid, params.currentTrial,
+						data.trialIndex, data.outputFieldCentroidHistory);
+			}
+			waitFor(20);
 			data.outputFieldCentroidHistory.clear();
 			dnfcomposerHandler.closeSimulation();
 		}
 
+		void ExperimentHandlerInducing::waitFor(int milliseconds) const
+		{
+			// Pacing is only needed to hand over to the simulation thread and the user interface.
+			if (!params.isHeadlessModeOn)
+				Sleep(milliseconds);
+		}
+
+		void ExperimentHandlerInducing::logThroughput(double elapsedSeconds, std::uint64_t numberOfSteps) const
+		{
+			const int numberOfTrials = params.numberOfTrials * static_cast<int>(hueToAngleMap.size() * params.degenerationSweep.size());
+
+			std::ostringstream stream;
+			stream << std::fixed << std::setprecision(2);
+			stream << "Executed " << numberOfTrials << " trials and " << numberOfSteps << " simulation steps in " << elapsedSeconds << " s ("
+				<< numberOfTrials / elapsedSeconds << " trials/s, " << static_cast<double>(numberOfSteps) / elapsedSeconds << " steps/s). ";
+
+			SettlingStatistics settlingStatistics = dnfcomposerHandler.getSettlingStatistics();
+			settlingStatistics.add(trialSchedulerSettlingStatistics);
+			stream << settlingStatistics.toString();
+			if (!params.isHeadlessModeOn)
+				stream << " " << dnfcomposerHandler.getCommandLatencyStatistics().toString();
+			if (params.isDataSavingOn)
+				stream << " " << resultsWriter.getStatistics().toString();
+			dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO, stream.str());
+		}
+
 		bool ExperimentHandlerInducing::hasOutputFieldDegenerated() const
 		{
 			const double outputFieldCentroid = dnfcomposerHandler.getOutputFieldCentroid();
@@ -163,35 +329,97 @@ namespace experiment
 			return false;
 		}
 
-		void ExperimentHandlerInducing::saveOutputFieldCentroidToFile() const
+		std::string ExperimentHandlerInducing::getResultsFilename(const DegenerationParameters& degenerationParameters,
+			double targetOutputFieldCentroid, const std::string& suffix) const
 		{
 			std::ostringstream ss;
-			ss << std::fixed << std::setprecision(1) << data.targetOutputFieldCentroid;
+			ss << std::fixed << std::setprecision(1) << targetOutputFieldCentroid;
 			const std::string decimalString = ss.str();
 
-			const std::string filename = std::string(OUTPUT_DIRECTORY) + "/results/" + decimalString + " " + params.degenerationParameters.name + " - centroids.txt";
-			std::ofstream file(filename, std::ios::app);
+			return std::string(OUTPUT_DIRECTORY) + "/results/" + decimalString + " " + degenerationParameters.name + " - " + suffix;
+		}
 
-			if (!file.is_open())
+		void ExperimentHandlerInducing::saveOutputFieldCentroidToFile(const DegenerationParameters& degenerationParameters,
+			double targetOutputFieldCentroid, int trial, int trialIndex, const CentroidHistory& outputFieldCentroidHistory)
+		{
+			ResultsWriteRequest request;
+			if (params.isBinaryResultsOn)
 			{
-				if (params.isDebugModeOn)
-				{
-					const std::string message = "Failed to open the file for writing " + filename + '.';
-					dnf_composer::tools::logger::log(dnf_composer::tools::logger::FATAL, message);
-				}
+				// The history is already encoded on the grid of the output field; the header records the grid.
+				request.filename = getResultsFilename(degenerationParameters, targetOutputFieldCentroid, "centroids.dnfr");
+				request.isBinary = true;
+				request.header = makeResultsFileHeader(ResultsSchema::CENTROID_HISTORY, ResultsValueType::CENTROID_CODEC,
+					degenerationParameters.type, targetOutputFieldCentroid, degenerationParameters.name,
+					outputFieldCentroidHistory.getStepSize(), outputFieldCentroidHistory.getMaxDenominator());
+				request.trial = static_cast<std::uint32_t>(trial);
+				request.trialIndex = static_cast<std::uint32_t>(trialIndex);
+				request.seed = params.randomSeed;
+				request.centroidHistory = outputFieldCentroidHistory;
+			}
+			else
+			{
+				request.filename = getResultsFilename(degenerationParameters, targetOutputFieldCentroid, "centroids.txt");
+				std::vector<double> centroids;
+				outputFieldCentroidHistory.decode(centroids);
+				std::ostringstream file;
+				for (const auto& centroid : centroids)
+					file << centroid << " ";
+				file << '\n';
+				request.text = file.str();
 			}
 
-			for (const auto& centroid : data.outputFieldCentroidHistory)
-				file << centroid << " ";
-			file << std::endl;
+			if (params.isDebugModeOn)
+			{
+				const std::string message = "New centroids queued for " + request.filename + '.';
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO, message);
+			}
+			resultsWriter.push(std::move(request));
+		}
 
-			file.close();
+		void ExperimentHandlerInducing::saveDegenerationThresholdToFile(const DegenerationParameters& degenerationParameters,
+			double targetOutputFieldCentroid, const DegenerationThreshold& degenerationThreshold)
+		{
+			ResultsWriteRequest request;
+			request.filename = getResultsFilename(degenerationParameters, targetOutputFieldCentroid, "thresholds.txt");
+
+			// One line per trial: degenerated elements at failure, candidates, centroid before and at failure.
+			std::ostringstream file;
+			file << degenerationThreshold.numberOfElements << " " << degenerationThreshold.numberOfCandidates << " "
+				<< degenerationThreshold.outputFieldCentroidBeforeThreshold << " " << degenerationThreshold.outputFieldCentroid << '\n';
+			request.text = file.str();
+
+			if (params.isDebugModeOn)
+			{
+				const std::string message = "New threshold queued for " + request.filename + '.';
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO, message);
+			}
+			resultsWriter.push(std::move(request));
+		}
+
+		void ExperimentHandlerInducing::saveAblationSensitivityMapToFile(const DegenerationParameters& degenerationParameters,
+			double targetOutputFieldCentroid, const AblationSensitivityMap& ablationSensitivityMap)
+		{
+			ResultsWriteRequest request;
+			request.filename = getResultsFilename(degenerationParameters, targetOutputFieldCentroid, "ablations.txt");
+
+			// Per trial: a line with the rows, columns and the centroid without ablation, then one line per
+			// row of the map with the output field centroid after each single ablation (-1 if the peak vanished).
+			std::ostringstream file;
+			file << ablationSensitivityMap.rows << " " << ablationSensitivityMap.cols << " " << ablationSensitivityMap.baselineOutputFieldCentroid << '\n';
+			for (int row = 0; row < ablationSensitivityMap.rows; row++)
+			{
+				for (int col = 0; col < ablationSensitivityMap.cols; col++)
+					file << ablationSensitivityMap.outputFieldCentroids[static_cast<size_t>(row) * ablationSensitivityMap.cols + col] << " ";
+				file << '\n';
+			}
+			request.text = file.str();
 
 			if (params.isDebugModeOn)
 			{
-				const std::string message = "New centroids appended to " + filename + '.';
+				const std::string message = "New ablation map queued for " + request.filename + '.';
 				dnf_composer::tools::logger::log(dnf_composer::tools::logger::INFO, message);
 			}
+			resultsWriter.push(std::move(request));
 		}
 
 		void ExperimentHandlerInducing::readHueToAngleMap()
@@ -1,10 +1,13 @@
 #include "experiment_parameters.h"
 
+#include "philox.h"
+
 namespace experiment
 {
 	ExperimentParameters::ExperimentParameters()
 	{
 		read();
+		setDegenerationSweep();
 	}
 
     void ExperimentParameters::read()
@@ -22,8 +25,53 @@ namespace experiment
         startingExternalStimulus = experimentParams.at("startingExternalStimulus").get<int>();
         decisionTolerance = experimentParams.at("decisionTolerance").get<double>();
         isDataSavingOn = experimentParams.at("isDataSavingOn").get<bool>();
+        isBinaryResultsOn = experimentParams.at("isBinaryResultsOn").get<bool>();
+        resultsQueueCapacity = experimentParams.at("resultsQueueCapacity").get<int>();
         isVisualizationOn = experimentParams.at("isVisualizationOn").get<bool>();
         isDebugModeOn = experimentParams.at("isDebugModeOn").get<bool>();
+        isHeadlessModeOn = experimentParams.at("isHeadlessModeOn").get<bool>();
+        numberOfThreads = experimentParams.at("numberOfThreads").get<int>();
+        batchSize = experimentParams.at("batchSize").get<int>();
+        sweepAllDegeneracyTypes = experimentParams.at("sweepAllDegeneracyTypes").get<bool>();
+        isSettledStateCacheOn = experimentParams.at("isSettledStateCacheOn").get<bool>();
+        reseedNoiseOnRestore = experimentParams.at("reseedNoiseOnRestore").get<bool>();
+        isSettlingAdaptive = experimentParams.at("isSettlingAdaptive").get<bool>();
+        settlingTolerance = experimentParams.at("settlingTolerance").get<double>();
+        settlingStableSteps = experimentParams.at("settlingStableSteps").get<int>();
+        maxTimeForFieldToSettle = experimentParams.at("maxTimeForFieldToSettle").get<int>();
+        isThresholdModeOn = experimentParams.at("isThresholdModeOn").get<bool>();
+        isAblationScanOn = experimentParams.at("isAblationScanOn").get<bool>();
+        isFastSigmoidOn = experimentParams.at("isFastSigmoidOn").get<bool>();
+        sparseCouplingDensity = experimentParams.at("sparseCouplingDensity").get<double>();
+        isIncrementalCouplingOn = experimentParams.at("isIncrementalCouplingOn").get<bool>();
+        incrementalCouplingTolerance = experimentParams.at("incrementalCouplingTolerance").get<double>();
+        incrementalCouplingResyncSteps = experimentParams.at("incrementalCouplingResyncSteps").get<int>();
+        randomSeed = experimentParams.at("randomSeed").get<std::uint64_t>();
+
+        // The drawn seed is printed with the parameters, so the run can still be replayed.
+        if (randomSeed == 0)
+            randomSeed = degeneration::PhiloxGenerator::randomKey();
+
+        // The threshold search and the ablation scan read the simulation directly.
+        if (isThresholdModeOn || isAblationScanOn)
+            isHeadlessModeOn = true;
+    }
+
+    void ExperimentParameters::setDegenerationSweep()
+    {
+        degenerationSweep.clear();
+        if (!sweepAllDegeneracyTypes)
+        {
+            degenerationSweep.push_back(degenerationParameters);
+            return;
+        }
+
+        using degeneration::ElementDegeneracyType;
+        degenerationSweep.emplace_back(ElementDegeneracyType::NEURONS_DEACTIVATE, "perceptual");
+        degenerationSweep.emplace_back(ElementDegeneracyType::NEURONS_DEACTIVATE, "output");
+        degenerationSweep.emplace_back(ElementDegeneracyType::WEIGHTS_DEACTIVATE, degenerationParameters.field);
+        degenerationSweep.emplace_back(ElementDegeneracyType::WEIGHTS_RANDOMIZE, degenerationParameters.field);
+        degenerationSweep.emplace_back(ElementDegeneracyType::WEIGHTS_REDUCE, degenerationParameters.field);
     }
 
 	std::string ExperimentParameters::toString() const
@@ -31,9 +79,30 @@ namespace experiment
         std::ostringstream logStream;
         logStream << "Experiment parameters" << std::endl;
         logStream << "----------------------------------------" << std::endl;
-        logStream << "Data saving is " << (isDataSavingOn ? "on" : "off") << std::endl;
+        logStream << "Data saving is " << (isDataSavingOn ? "on" : "off")
+            << (isDataSavingOn && isBinaryResultsOn ? " (binary centroid files)" : "") << std::endl;
+        logStream << "Results queue capacity: " << resultsQueueCapacity << std::endl;
         logStream << "Debug mode is " << (isDebugModeOn ? "on" : "off") << std::endl;
         logStream << "Visualization is " << (isVisualizationOn ? "on" : "off") << std::endl;
+        logStream << "Headless mode is " << (isHeadlessModeOn ? "on" : "off") << std::endl;
+        logStream << "Number of threads: " << numberOfThreads << std::endl;
+        logStream << "Batch size: " << batchSize << std::endl;
+        logStream << "Sweep of all degeneracy types is " << (sweepAllDegeneracyTypes ? "on" : "off") << std::endl;
+        logStream << "Settled state cache is " << (isSettledStateCacheOn ? "on" : "off")
+            << (reseedNoiseOnRestore ? " (noise reseeded on restore)" : "") << std::endl;
+        logStream << "Adaptive settling is " << (isSettlingAdaptive ? "on" : "off");
+        if (isSettlingAdaptive)
+            logStream << " (tolerance " << settlingTolerance << " for " << settlingStableSteps << " steps, at most " << maxTimeForFieldToSettle << " steps)";
+        logStream << std::endl;
+        logStream << "Fast sigmoid is " << (isFastSigmoidOn ? "on" : "off") << std::endl;
+        logStream << "Sparse coupling below density: " << sparseCouplingDensity << std::endl;
+        logStream << "Incremental coupling output is " << (isIncrementalCouplingOn ? "on" : "off");
+        if (isIncrementalCouplingOn)
+            logStream << " (input tolerance " << incrementalCouplingTolerance << ", resync every " << incrementalCouplingResyncSteps << " steps)";
+        logStream << std::endl;
+        logStream << "Threshold mode is " << (isThresholdModeOn ? "on" : "off") << std::endl;
+        logStream << "Ablation scan is " << (isAblationScanOn ? "on" : "off") << std::endl;
+        logStream << "Random seed: " << randomSeed << std::endl;
         logStream << "Number of trials: " << numberOfTrials << std::endl;
         logStream << "Decision tolerance: " << decisionTolerance << std::endl;
         logStream << "----------------------------------------" << std::endl;
@@ -0,0 +1,63 @@
+#include "fft_gauss_kernel.h"
+
+#include <numeric>
+
+FftGaussKernel::FftGaussKernel(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
+	const dnf_composer::element::GaussKernelParameters& parameters)
+	: GaussKernel(elementCommonParameters, parameters)
+{
+}
+
+void FftGaussKernel::init()
+{
+	// The base class computes the sampled kernel (amplitude, width, normalization, range) as usual.
+	GaussKernel::init();
+	input = getComponentPtr("input");
+	output = getComponentPtr("output");
+	method = ConvolutionMethod::DIRECT;
+
+	const std::vector<double>& kernel = *getComponentPtr("kernel");
+	const int size = commonParameters.dimensionParameters.size;
+	const int kernelLength = static_cast<int>(kernel.size());
+	if (!parameters.circular || kernelLength % 2 == 0 || requestedMethod == ConvolutionMethod::DIRECT)
+		return;
+
+	const double directCost = static_cast<double>(size) * kernelLength;
+	if (requestedMethod == ConvolutionMethod::AUTOMATIC && directCost <= experiment::degeneration::CircularConvolution::estimateCost(size))
+		return;
+
+	// Fold the symmetric kernel onto the circle: offset d in [-range, range] lands on d mod N.
+	const int range = kernelLength / 2;
+	std::vector<double> circularKernel(size, 0.0);
+	for (int d = -range; d <= range; d++)
+		circularKernel[((d % size) + size) % size] += kernel[range + d];
+	convolution.setKernel(circularKernel);
+	method = ConvolutionMethod::FFT;
+}
+
+void FftGaussKernel::step(double t, double deltaT)
+{
+	if (method == ConvolutionMethod::DIRECT)
+	{
+		GaussKernel::step(t, deltaT);
+		return;
+	}
+
+	// Same output as GaussKernel::step: circular convolution plus the global term on the summed input.
+	updateInput();
+	const double fullSum = std::accumulate(input->begin(), input->end(), 0.0);
+	convolution.convolve(input->data(), output->data());
+	const double global = parameters.amplitudeGlobal * fullSum;
+	for (double& value : *output)
+		value += global;
+}
+
+void FftGaussKernel::setConvolutionMethod(ConvolutionMethod method)
+{
+	requestedMethod = method;
+}
+
+FftGaussKernel::ConvolutionMethod FftGaussKernel::getConvolutionMethod() const
+{
+	return method;
+}
@@ -0,0 +1,96 @@
+#include "mapped_file.h"
+
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI // keeps the ERROR macro away from the logger levels
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		MappedFile::~MappedFile()
+		{
+			close();
+		}
+
+		bool MappedFile::open(const std::string& filename)
+		{
+			close();
+
+			std::error_code error;
+			const std::size_t fileSize = std::filesystem::file_size(filename, error);
+			if (error || fileSize == 0)
+				return false;
+
+#ifdef _WIN32
+			const HANDLE fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (fileHandle != INVALID_HANDLE_VALUE)
+			{
+				mapping = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				CloseHandle(fileHandle);
+				if (mapping)
+					data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			}
+#else
+			const int descriptor = ::open(filename.c_str(), O_RDONLY);
+			if (descriptor >= 0)
+			{
+				void* view = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+				::close(descriptor);
+				if (view != MAP_FAILED)
+				{
+					data = static_cast<const unsigned char*>(view);
+					mapping = view;
+				}
+			}
+#endif
+			if (!data)
+			{
+				close();
+				return false;
+			}
+			size = fileSize;
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+#ifdef _WIN32
+			if (data)
+				UnmapViewOfFile(data);
+			if (mapping)
+				CloseHandle(mapping);
+#else
+			if (mapping)
+				munmap(mapping, size);
+#endif
+			data = nullptr;
+			mapping = nullptr;
+			size = 0;
+		}
+
+		bool MappedFile::isOpen() const
+		{
+			return data != nullptr;
+		}
+
+		const unsigned char* MappedFile::getData() const
+		{
+			return data;
+		}
+
+		std::size_t MappedFile::getSize() const
+		{
+			return size;
+		}
+	}
+}
@@ -0,0 +1,308 @@
+#include "philox.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <random>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		namespace
+		{
+			constexpr std::uint32_t multiplier0 = 0xD2511F53;
+			constexpr std::uint32_t multiplier1 = 0xCD9E8D57;
+			constexpr std::uint32_t weyl0 = 0x9E3779B9;
+			constexpr std::uint32_t weyl1 = 0xBB67AE85;
+			constexpr int numberOfRounds = 10;
+			constexpr int batchSize = 64; // blocks per batch in fillNormal
+
+			constexpr std::uint64_t exponentOfOne = 0x3FF0000000000000;
+			constexpr std::uint64_t mantissaMask = 0x000FFFFFFFFFFFFF;
+			constexpr double sqrt2 = 1.4142135623730951;
+			constexpr double ln2 = 0.6931471805599453;
+			constexpr double halfPi = 1.5707963267948966;
+			// 2 atanh(s) = log((1 + s) / (1 - s)) in powers of s^2, and the Taylor series of sin and cos on [-pi/4, pi/4].
+			constexpr double logCoefficients[] = { 2.0 / 17, 2.0 / 15, 2.0 / 13, 2.0 / 11, 2.0 / 9, 2.0 / 7, 2.0 / 5, 2.0 / 3, 2.0 };
+			constexpr double sinCoefficients[] = { -1.0 / 1307674368000.0, 1.0 / 6227020800.0, -1.0 / 39916800.0, 1.0 / 362880.0, -1.0 / 5040.0, 1.0 / 120.0, -1.0 / 6.0, 1.0 };
+			constexpr double cosCoefficients[] = { -1.0 / 87178291200.0, 1.0 / 479001600.0, -1.0 / 3628800.0, 1.0 / 40320.0, -1.0 / 720.0, 1.0 / 24.0, -0.5, 1.0 };
+
+			// 52 random bits to a double in [0, 1).
+			inline double toUniform(std::uint64_t bits)
+			{
+				return std::bit_cast<double>((bits >> 12) | exponentOfOne) - 1.0;
+			}
+
+			// Box-Muller with polynomial log, sin and cos (errors around 1e-15), mirrored by the AVX2 path below.
+			inline void boxMuller(std::uint64_t first, std::uint64_t second, double& normal0, double& normal1)
+			{
+				// log of u in (0, 1]: u = m 2^e with m in [sqrt(2)/2, sqrt(2))
+				const double u = 2.0 - std::bit_cast<double>((first >> 12) | exponentOfOne);
+				const std::uint64_t bits = std::bit_cast<std::uint64_t>(u);
+				double exponent = static_cast<double>(static_cast<std::int64_t>(bits >> 52) - 1023);
+				double mantissa = std::bit_cast<double>((bits & mantissaMask) | exponentOfOne);
+				if (mantissa > sqrt2)
+				{
+					mantissa *= 0.5;
+					exponent += 1.0;
+				}
+				const double s = (mantissa - 1.0) / (mantissa + 1.0);
+				const double z = s * s;
+				double logarithm = logCoefficients[0];
+				for (int k = 1; k < 9; k++)
+					logarithm = logarithm * z + logCoefficients[k];
+				logarithm = logarithm * s + exponent * ln2;
+				const double radius = std::sqrt(-2.0 * logarithm);
+
+				// angle = 2 pi v = (pi / 2) (quadrant + f) with f in [-1/2, 1/2]
+				const double turns = 4.0 * toUniform(second);
+				const double quadrant = std::nearbyint(turns);
+				const double theta = (turns - quadrant) * halfPi;
+				const double theta2 = theta * theta;
+				double sine = sinCoefficients[0], cosine = cosCoefficients[0];
+				for (int k = 1; k < 8; k++)
+				{
+					sine = sine * theta2 + sinCoefficients[k];
+					cosine = cosine * theta2 + cosCoefficients[k];
+				}
+				sine *= theta;
+
+				const int q = static_cast<int>(quadrant) & 3;
+				const double c = (q & 1) ? sine : cosine;
+				const double t = (q & 1) ? cosine : sine;
+				normal0 = radius * (((q + 1) & 2) ? -c : c);
+				normal1 = radius * ((q & 2) ? -t : t);
+			}
+
+			inline void generateBlocksScalar(std::uint32_t key0, std::uint32_t key1, std::uint32_t stream0, std::uint32_t stream1,
+				std::uint64_t blockIndex, std::uint64_t& first, std::uint64_t& second)
+			{
+				std::uint32_t c0 = static_cast<std::uint32_t>(blockIndex);
+				std::uint32_t c1 = static_cast<std::uint32_t>(blockIndex >> 32);
+				std::uint32_t c2 = stream0;
+				std::uint32_t c3 = stream1;
+				std::uint32_t k0 = key0;
+				std::uint32_t k1 = key1;
+
+				for (int round = 0; round < numberOfRounds; round++)
+				{
+					const std::uint64_t product0 = static_cast<std::uint64_t>(multiplier0) * c0;
+					const std::uint64_t product1 = static_cast<std::uint64_t>(multiplier1) * c2;
+					const std::uint32_t next0 = static_cast<std::uint32_t>(product1 >> 32) ^ c1 ^ k0;
+					const std::uint32_t next2 = static_cast<std::uint32_t>(product0 >> 32) ^ c3 ^ k1;
+					c1 = static_cast<std::uint32_t>(product1);
+					c3 = static_cast<std::uint32_t>(product0);
+					c0 = next0;
+					c2 = next2;
+					k0 += weyl0;
+					k1 += weyl1;
+				}
+
+				first = (static_cast<std::uint64_t>(c0) << 32) | c1;
+				second = (static_cast<std::uint64_t>(c2) << 32) | c3;
+			}
+
+#if defined(__AVX2__)
+			// Four blocks at once; every 32 bit word of the counter lives in the low half of a 64 bit lane.
+			inline void generateBlocksAvx2(std::uint32_t key0, std::uint32_t key1, std::uint32_t stream0, std::uint32_t stream1,
+				std::uint64_t firstBlock, std::uint64_t* first, std::uint64_t* second)
+			{
+				const __m256i low = _mm256_set1_epi64x(0xFFFFFFFF);
+				const __m256i blockIndex = _mm256_add_epi64(_mm256_set1_epi64x(static_cast<long long>(firstBlock)), _mm256_setr_epi64x(0, 1, 2, 3));
+				__m256i c0 = _mm256_and_si256(blockIndex, low);
+				__m256i c1 = _mm256_srli_epi64(blockIndex, 32);
+				__m256i c2 = _mm256_set1_epi64x(stream0);
+				__m256i c3 = _mm256_set1_epi64x(stream1);
+				std::uint32_t k0 = key0, k1 = key1;
+				const __m256i m0 = _mm256_set1_epi64x(multiplier0);
+				const __m256i m1 = _mm256_set1_epi64x(multiplier1);
+
+				for (int round = 0; round < numberOfRounds; round++)
+				{
+					const __m256i product0 = _mm256_mul_epu32(m0, c0);
+					const __m256i product1 = _mm256_mul_epu32(m1, c2);
+					const __m256i next0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product1, 32), c1), _mm256_set1_epi64x(k0));
+					const __m256i next2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(product0, 32), c3), _mm256_set1_epi64x(k1));
+					c1 = _mm256_and_si256(product1, low);
+					c3 = _mm256_and_si256(product0, low);
+					c0 = next0;
+					c2 = next2;
+					k0 += weyl0;
+					k1 += weyl1;
+				}
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(first), _mm256_or_si256(_mm256_slli_epi64(c0, 32), c1));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(second), _mm256_or_si256(_mm256_slli_epi64(c2, 32), c3));
+			}
+
+			inline __m256d horner(const double* coefficients, int count, __m256d x)
+			{
+				__m256d result = _mm256_set1_pd(coefficients[0]);
+				for (int k = 1; k < count; k++)
+					result = _mm256_add_pd(_mm256_mul_pd(result, x), _mm256_set1_pd(coefficients[k]));
+				return result;
+			}
+
+			inline void boxMullerAvx2(const std::uint64_t* first, const std::uint64_t* second, double* normal0, double* normal1)
+			{
+				const __m256i one = _mm256_set1_epi64x(static_cast<long long>(exponentOfOne));
+				const __m256d onePd = _mm256_castsi256_pd(one);
+
+				const __m256d u = _mm256_sub_pd(_mm256_set1_pd(2.0),
+					_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(first)), 12), one)));
+				const __m256i bits = _mm256_castpd_si256(u);
+				// exponent + 1023 as a double: small non-negative integers are exact in the mantissa of 2^52
+				const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+				__m256d exponent = _mm256_sub_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), _mm256_castpd_si256(magic))), magic),
+					_mm256_set1_pd(1023.0));
+				__m256d mantissa = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(static_cast<long long>(mantissaMask))), one));
+				const __m256d isLarge = _mm256_cmp_pd(mantissa, _mm256_set1_pd(sqrt2), _CMP_GT_OQ);
+				mantissa = _mm256_blendv_pd(mantissa, _mm256_mul_pd(mantissa, _mm256_set1_pd(0.5)), isLarge);
+				exponent = _mm256_blendv_pd(exponent, _mm256_add_pd(exponent, onePd), isLarge);
+				const __m256d s = _mm256_div_pd(_mm256_sub_pd(mantissa, onePd), _mm256_add_pd(mantissa, onePd));
+				const __m256d logarithm = _mm256_add_pd(_mm256_mul_pd(horner(logCoefficients, 9, _mm256_mul_pd(s, s)), s),
+					_mm256_mul_pd(exponent, _mm256_set1_pd(ln2)));
+				const __m256d radius = _mm256_sqrt_pd(_mm256_mul_pd(_mm256_set1_pd(-2.0), logarithm));
+
+				const __m256d v = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(second)), 12), one)), onePd);
+				const __m256d turns = _mm256_mul_pd(_mm256_set1_pd(4.0), v);
+				const __m256d quadrant = _mm256_round_pd(turns, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+				const __m256d theta = _mm256_mul_pd(_mm256_sub_pd(turns, quadrant), _mm256_set1_pd(halfPi));
+				const __m256d theta2 = _mm256_mul_pd(theta, theta);
+				const __m256d sine = _mm256_mul_pd(horner(sinCoefficients, 8, theta2), theta);
+				const __m256d cosine = horner(cosCoefficients, 8, theta2);
+
+				const __m256i q = _mm256_and_si256(_mm256_castpd_si256(_mm256_add_pd(quadrant, magic)), _mm256_set1_epi64x(3));
+				const __m256d isOdd = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_and_si256(q, _mm256_set1_epi64x(1)), _mm256_set1_epi64x(1)));
+				const __m256d c = _mm256_blendv_pd(cosine, sine, isOdd);
+				const __m256d t = _mm256_blendv_pd(sine, cosine, isOdd);
+				const __m256d signOfC = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(q, _mm256_set1_epi64x(1)), _mm256_set1_epi64x(2)), 62));
+				const __m256d signOfT = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(q, _mm256_set1_epi64x(2)), 62));
+				_mm256_storeu_pd(normal0, _mm256_mul_pd(radius, _mm256_xor_pd(c, signOfC)));
+				_mm256_storeu_pd(normal1, _mm256_mul_pd(radius, _mm256_xor_pd(t, signOfT)));
+			}
+#endif
+		}
+
+		PhiloxGenerator::PhiloxGenerator()
+			: PhiloxGenerator(randomKey(), 0)
+		{
+		}
+
+		PhiloxGenerator::PhiloxGenerator(std::uint64_t key, std::uint64_t stream)
+		{
+			seed(key, stream);
+		}
+
+		void PhiloxGenerator::seed(std::uint64_t key, std::uint64_t stream)
+		{
+			this->key = key;
+			this->stream = stream;
+			blockCounter = 0;
+			bufferPosition = 2;
+		}
+
+		PhiloxGenerator::result_type PhiloxGenerator::operator()()
+		{
+			if (bufferPosition >= 2)
+			{
+				buffer = generateBlock(key, stream, blockCounter++);
+				bufferPosition = 0;
+			}
+			return buffer[bufferPosition++];
+		}
+
+		std::uint64_t PhiloxGenerator::below(std::uint64_t bound)
+		{
+			// Rejection keeps the draw unbiased (standard distributions are not reproducible across libraries).
+			const std::uint64_t limit = max() - max() % bound;
+			std::uint64_t draw;
+			do draw = (*this)(); while (draw >= limit);
+			return draw % bound;
+		}
+
+		double PhiloxGenerator::uniform()
+		{
+			return toUniform((*this)());
+		}
+
+		double PhiloxGenerator::uniform(double min, double max)
+		{
+			return min + (max - min) * uniform();
+		}
+
+		void PhiloxGenerator::fillNormal(double* output, int count)
+		{
+			std::uint64_t first[batchSize], second[batchSize];
+			double normal0[batchSize], normal1[batchSize];
+			int written = 0;
+			while (written < count)
+			{
+				const int numberOfBlocks = std::min(batchSize, (count - written + 1) / 2);
+				generateBlocks(key, stream, blockCounter, numberOfBlocks, first, second);
+				blockCounter += numberOfBlocks;
+
+				int b = 0;
+#if defined(__AVX2__)
+				for (; b + 4 <= numberOfBlocks; b += 4)
+					boxMullerAvx2(first + b, second + b, normal0 + b, normal1 + b);
+#endif
+				for (; b < numberOfBlocks; b++)
+					boxMuller(first[b], second[b], normal0[b], normal1[b]);
+
+				for (b = 0; b < numberOfBlocks; b++)
+				{
+					output[written++] = normal0[b];
+					if (written < count)
+						output[written++] = normal1[b];
+				}
+			}
+		}
+
+		std::uint64_t PhiloxGenerator::getKey() const
+		{
+			return key;
+		}
+
+		std::uint64_t PhiloxGenerator::getStream() const
+		{
+			return stream;
+		}
+
+		std::uint64_t PhiloxGenerator::randomKey()
+		{
+			std::random_device device;
+			return (static_cast<std::uint64_t>(device()) << 32) | device();
+		}
+
+		PhiloxGenerator::Block PhiloxGenerator::generateBlock(std::uint64_t key, std::uint64_t stream, std::uint64_t blockIndex)
+		{
+			Block block;
+			generateBlocks(key, stream, blockIndex, 1, &block[0], &block[1]);
+			return block;
+		}
+
+		void PhiloxGenerator::generateBlocks(std::uint64_t key, std::uint64_t stream, std::uint64_t firstBlock, int count,
+			std::uint64_t* first, std::uint64_t* second)
+		{
+			// Counter = {block index, stream}, key = key; block b yields first[b] = words 0-1 and second[b] = words 2-3.
+			const std::uint32_t key0 = static_cast<std::uint32_t>(key);
+			const std::uint32_t key1 = static_cast<std::uint32_t>(key >> 32);
+			const std::uint32_t stream0 = static_cast<std::uint32_t>(stream);
+			const std::uint32_t stream1 = static_cast<std::uint32_t>(stream >> 32);
+
+			int b = 0;
+#if defined(__AVX2__)
+			for (; b + 4 <= count; b += 4)
+				generateBlocksAvx2(key0, key1, stream0, stream1, firstBlock + b, first + b, second + b);
+#endif
+			for (; b < count; b++)
+				generateBlocksScalar(key0, key1, stream0, stream1, firstBlock + b, first[b], second[b]);
+		}
+	}
+}
@@ -0,0 +1,38 @@
+#include "philox_normal_noise.h"
+
+#include <cmath>
+
+PhiloxNormalNoise::PhiloxNormalNoise(const dnf_composer::element::ElementCommonParameters& elementCommonParameters,
+	const dnf_composer::element::NormalNoiseParameters& parameters)
+	: NormalNoise(elementCommonParameters, parameters)
+{
+}
+
+void PhiloxNormalNoise::init()
+{
+	// The stream is left where it is: a simulation init() within a trial keeps drawing from the trial's stream.
+	NormalNoise::init();
+	output = getComponentPtr("output");
+}
+
+void PhiloxNormalNoise::step(double /*t*/, double deltaT)
+{
+	// Same scaling as NormalNoise::step.
+	const int size = commonParameters.dimensionParameters.size;
+	const double scale = parameters.amplitude / std::sqrt(deltaT);
+	double* samples = output->data();
+
+	generator.fillNormal(samples, size);
+	for (int i = 0; i < size; i++)
+		samples[i] *= scale;
+}
+
+void PhiloxNormalNoise::setStream(std::uint64_t seed, std::uint64_t stream)
+{
+	generator.seed(seed, stream);
+}
+
+double PhiloxNormalNoise::getAmplitude() const
+{
+	return parameters.amplitude;
+}
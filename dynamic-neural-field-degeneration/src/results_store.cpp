@@ -0,0 +1,457 @@
+#include "results_store.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		namespace
+		{
+			constexpr char resultsMagic[8] = { 'D', 'N', 'F', 'R', 'E', 'S', 'L', 'T' };
+			constexpr std::uint32_t resultsVersion = 2;
+			constexpr int textSignificantDigits = 6; // default precision of the text streams
+
+			std::size_t paddedSize(std::size_t size)
+			{
+				return (size + 7) & ~static_cast<std::size_t>(7);
+			}
+
+			std::size_t getRecordSize(const ResultsRecordHeader& record)
+			{
+				return sizeof(ResultsRecordHeader) + paddedSize(record.numberOfBytes);
+			}
+
+			bool isHeaderValid(const ResultsFileHeader& header)
+			{
+				return std::memcmp(header.magic, resultsMagic, sizeof(resultsMagic)) == 0 && header.version == resultsVersion
+					&& (header.valueType == ResultsValueType::FLOAT32 || header.valueType == ResultsValueType::FLOAT64
+						|| header.valueType == ResultsValueType::CENTROID_CODEC);
+			}
+
+			// Packed values fill their record exactly; the size of encoded values is only known to the decoder.
+			bool isRecordSizeValid(const ResultsFileHeader& header, const ResultsRecordHeader& record)
+			{
+				if (header.valueType == ResultsValueType::CENTROID_CODEC)
+					return true;
+				const std::uint64_t valueSize = static_cast<std::uint64_t>(header.valueType);
+				return record.numberOfBytes % valueSize == 0 && record.numberOfValues == record.numberOfBytes / valueSize;
+			}
+
+			// Size of the file up to its last complete record, or 0 if it is not a results file.
+			std::size_t getValidSize(const std::string& filename, ResultsFileHeader& header)
+			{
+				std::ifstream file(filename, std::ios::binary);
+				if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || !isHeaderValid(header))
+					return 0;
+
+				const std::size_t fileSize = std::filesystem::file_size(filename);
+				std::size_t offset = sizeof(ResultsFileHeader);
+				ResultsRecordHeader record{};
+				while (file.seekg(static_cast<std::streamoff>(offset)) && file.read(reinterpret_cast<char*>(&record), sizeof(record)))
+				{
+					const std::size_t recordSize = getRecordSize(record);
+					if (record.numberOfBytes > fileSize || recordSize > fileSize - offset)
+						break;
+					offset += recordSize;
+				}
+				return offset;
+			}
+
+			ElementDegeneracyType getDegeneracyTypeFromName(const std::string& name)
+			{
+				if (name.find("neurons") != std::string::npos)
+					return ElementDegeneracyType::NEURONS_DEACTIVATE;
+				if (name.find("randomize") != std::string::npos)
+					return ElementDegeneracyType::WEIGHTS_RANDOMIZE;
+				if (name.find("reduce") != std::string::npos)
+					return ElementDegeneracyType::WEIGHTS_REDUCE;
+				if (name.find("deactivate") != std::string::npos)
+					return ElementDegeneracyType::WEIGHTS_DEACTIVATE;
+				return ElementDegeneracyType::NONE;
+			}
+		}
+
+		ResultsFileHeader makeResultsFileHeader(ResultsSchema schema, ResultsValueType valueType, ElementDegeneracyType degeneracyType,
+			double position, const std::string& name, double stepSize, int gridSize)
+		{
+			ResultsFileHeader header{};
+			std::memcpy(header.magic, resultsMagic, sizeof(resultsMagic));
+			header.version = resultsVersion;
+			header.schema = schema;
+			header.valueType = valueType;
+			header.degeneracyType = degeneracyType;
+			header.position = position;
+			header.stepSize = stepSize;
+			header.gridSize = static_cast<std::uint32_t>(gridSize);
+			std::strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+			return header;
+		}
+
+		bool syncFile(std::FILE* file)
+		{
+			if (std::fflush(file) != 0)
+				return false;
+#ifdef _WIN32
+			return _commit(_fileno(file)) == 0;
+#else
+			return fsync(fileno(file)) == 0;
+#endif
+		}
+
+		ResultsWriter::~ResultsWriter()
+		{
+			close();
+		}
+
+		bool ResultsWriter::open(const std::string& filename, const ResultsFileHeader& header)
+		{
+			close();
+			this->filename = filename;
+			this->header = header;
+			buffer.clear();
+
+			std::error_code error;
+			if (std::filesystem::exists(filename, error))
+			{
+				ResultsFileHeader existingHeader{};
+				const std::size_t validSize = getValidSize(filename, existingHeader);
+				// Encoded centroids are decoded on the grid of the file header, so a run on another grid cannot append.
+				if (validSize == 0 || existingHeader.schema != header.schema || existingHeader.valueType != header.valueType
+					|| existingHeader.stepSize != header.stepSize || existingHeader.gridSize != header.gridSize
+					|| existingHeader.position != header.position || existingHeader.degeneracyType != header.degeneracyType)
+				{
+					const std::string message = "Cannot append to " + filename + ", it is not a results file of the same schema, value type, grid, position and degeneracy type.";
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, message);
+					return false;
+				}
+				// Drop a record cut short by an interrupted run before appending.
+				if (validSize < std::filesystem::file_size(filename))
+					std::filesystem::resize_file(filename, validSize, error);
+				file = std::fopen(filename.c_str(), "ab");
+			}
+			else
+			{
+				file = std::fopen(filename.c_str(), "wb");
+				if (file && std::fwrite(&header, sizeof(header), 1, file) != 1)
+					close();
+			}
+
+			if (!file)
+			{
+				const std::string message = "Failed to open the file for writing " + filename + '.';
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, message);
+				return false;
+			}
+			return true;
+		}
+
+		void ResultsWriter::pack(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, const std::vector<double>& values)
+		{
+			if (header.valueType == ResultsValueType::CENTROID_CODEC)
+			{
+				std::vector<std::uint8_t> encodedValues;
+				CentroidHistory::encode(values.data(), values.size(), header.stepSize, static_cast<int>(header.gridSize), encodedValues);
+				packEncoded(trial, trialIndex, seed, values.size(), encodedValues);
+				return;
+			}
+
+			const ResultsRecordHeader record{ trial, trialIndex, seed, values.size(), values.size() * static_cast<std::size_t>(header.valueType) };
+			const std::size_t recordOffset = buffer.size();
+			buffer.resize(recordOffset + getRecordSize(record), 0);
+			std::memcpy(buffer.data() + recordOffset, &record, sizeof(record));
+
+			unsigned char* packedValues = buffer.data() + recordOffset + sizeof(record);
+			if (header.valueType == ResultsValueType::FLOAT32)
+			{
+				for (std::size_t i = 0; i < values.size(); i++)
+				{
+					const float value = static_cast<float>(values[i]);
+					std::memcpy(packedValues + i * sizeof(float), &value, sizeof(float));
+				}
+			}
+			else if (!values.empty())
+				std::memcpy(packedValues, values.data(), values.size() * sizeof(double));
+		}
+
+		void ResultsWriter::packEncoded(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, std::uint64_t numberOfValues,
+			const std::vector<std::uint8_t>& encodedValues)
+		{
+			const ResultsRecordHeader record{ trial, trialIndex, seed, numberOfValues, encodedValues.size() };
+			const std::size_t recordOffset = buffer.size();
+			buffer.resize(recordOffset + getRecordSize(record), 0);
+			std::memcpy(buffer.data() + recordOffset, &record, sizeof(record));
+			if (!encodedValues.empty())
+				std::memcpy(buffer.data() + recordOffset + sizeof(record), encodedValues.data(), encodedValues.size());
+		}
+
+		bool ResultsWriter::write()
+		{
+			if (!file)
+			{
+				buffer.clear();
+				return false;
+			}
+
+			// Flushed (without a sync) after every write, so the file can be read while the experiment runs.
+			const bool isWritten = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && std::fflush(file) == 0;
+			buffer.clear();
+			if (!isWritten)
+			{
+				const std::string message = "Failed to append records to " + filename + '.';
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, message);
+			}
+			return isWritten;
+		}
+
+		bool ResultsWriter::append(std::uint32_t trial, std::uint32_t trialIndex, std::uint64_t seed, const std::vector<double>& values)
+		{
+			pack(trial, trialIndex, seed, values);
+			return write();
+		}
+
+		bool ResultsWriter::sync()
+		{
+			return file && syncFile(file);
+		}
+
+		void ResultsWriter::close()
+		{
+			if (file)
+				std::fclose(file);
+			file = nullptr;
+		}
+
+		bool ResultsWriter::isOpen() const
+		{
+			return file != nullptr;
+		}
+
+		std::size_t ResultsWriter::getNumberOfPendingBytes() const
+		{
+			return buffer.size();
+		}
+
+		ResultsReader::~ResultsReader()
+		{
+			close();
+		}
+
+		bool ResultsReader::open(const std::string& filename)
+		{
+			close();
+
+			std::error_code error;
+			const std::size_t fileSize = std::filesystem::file_size(filename, error);
+			if (error || fileSize < sizeof(ResultsFileHeader))
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to open the results file " + filename + '.');
+				return false;
+			}
+
+			if (!file.open(filename))
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to map the results file " + filename + '.');
+				return false;
+			}
+			const unsigned char* data = file.getData();
+			const std::size_t size = file.getSize();
+
+			std::memcpy(&header, data, sizeof(header));
+			if (!isHeaderValid(header))
+			{
+				close();
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, filename + " is not a results file.");
+				return false;
+			}
+
+			std::size_t offset = sizeof(ResultsFileHeader);
+			ResultsRecordHeader record{};
+			while (size - offset >= sizeof(record))
+			{
+				std::memcpy(&record, data + offset, sizeof(record));
+				const std::size_t recordSize = getRecordSize(record);
+				if (record.numberOfBytes > size || recordSize > size - offset)
+					break;
+				if (!isRecordSizeValid(header, record))
+				{
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Skipped a record of " + filename
+						+ " whose size does not match its number of values.");
+					offset += recordSize;
+					continue;
+				}
+
+				trials.push_back(record.trial);
+				trialIndices.push_back(record.trialIndex);
+				seeds.push_back(record.seed);
+				numberOfValues.push_back(record.numberOfValues);
+				numberOfBytes.push_back(record.numberOfBytes);
+				valueOffsets.push_back(offset + sizeof(record));
+				offset += recordSize;
+			}
+			return true;
+		}
+
+		void ResultsReader::close()
+		{
+			file.close();
+			trials.clear();
+			trialIndices.clear();
+			seeds.clear();
+			numberOfValues.clear();
+			numberOfBytes.clear();
+			valueOffsets.clear();
+		}
+
+		const ResultsFileHeader& ResultsReader::getHeader() const
+		{
+			return header;
+		}
+
+		std::size_t ResultsReader::getNumberOfRecords() const
+		{
+			return trials.size();
+		}
+
+		const std::vector<std::uint32_t>& ResultsReader::getTrials() const
+		{
+			return trials;
+		}
+
+		const std::vector<std::uint32_t>& ResultsReader::getTrialIndices() const
+		{
+			return trialIndices;
+		}
+
+		const std::vector<std::uint64_t>& ResultsReader::getSeeds() const
+		{
+			return seeds;
+		}
+
+		const std::vector<std::uint64_t>& ResultsReader::getNumberOfValues() const
+		{
+			return numberOfValues;
+		}
+
+		const float* ResultsReader::getFloatValues(std::size_t record) const
+		{
+			// Records start 8-byte aligned in a page-aligned mapping.
+			if (header.valueType != ResultsValueType::FLOAT32)
+				return nullptr;
+			return reinterpret_cast<const float*>(file.getData() + valueOffsets[record]);
+		}
+
+		const double* ResultsReader::getDoubleValues(std::size_t record) const
+		{
+			if (header.valueType != ResultsValueType::FLOAT64)
+				return nullptr;
+			return reinterpret_cast<const double*>(file.getData() + valueOffsets[record]);
+		}
+
+		bool ResultsReader::copyValues(std::size_t record, std::vector<double>& values) const
+		{
+			const std::size_t count = numberOfValues[record];
+			if (const float* floatValues = getFloatValues(record))
+				values.assign(floatValues, floatValues + count);
+			else if (const double* doubleValues = getDoubleValues(record))
+				values.assign(doubleValues, doubleValues + count);
+			else if (!CentroidHistory::decode(file.getData() + valueOffsets[record], numberOfBytes[record], count, header.stepSize, values))
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Record " + std::to_string(record) + " of the results file does not decode.");
+				return false;
+			}
+			return true;
+		}
+
+		bool convertTextToResults(const std::string& textFilename, const std::string& resultsFilename, ResultsValueType valueType,
+			double stepSize, int gridSize)
+		{
+			std::ifstream textFile(textFilename);
+			if (!textFile.is_open())
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to open the text results file " + textFilename + '.');
+				return false;
+			}
+
+			// "<position> <name> - centroids"
+			const std::string stem = std::filesystem::path(textFilename).stem().string();
+			const std::size_t nameStart = stem.find(' ');
+			const std::size_t nameEnd = stem.rfind(" - ");
+			if (nameStart == std::string::npos || nameEnd == std::string::npos || nameEnd <= nameStart)
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Cannot read the position and name from " + textFilename + '.');
+				return false;
+			}
+			const std::string name = stem.substr(nameStart + 1, nameEnd - nameStart - 1);
+			const double position = std::strtod(stem.c_str(), nullptr);
+
+			std::error_code error;
+			std::filesystem::remove(resultsFilename, error);
+			ResultsWriter writer;
+			if (!writer.open(resultsFilename, makeResultsFileHeader(ResultsSchema::CENTROID_HISTORY, valueType,
+				getDegeneracyTypeFromName(name), position, name, stepSize, gridSize)))
+				return false;
+
+			std::string line;
+			std::vector<double> values;
+			std::vector<std::uint8_t> encodedValues;
+			std::uint32_t trial = 0;
+			while (std::getline(textFile, line))
+			{
+				values.clear();
+				const char* cursor = line.c_str();
+				char* end = nullptr;
+				for (double value = std::strtod(cursor, &end); end != cursor; value = std::strtod(cursor, &end))
+				{
+					values.push_back(value);
+					cursor = end;
+				}
+				// The text layout has no trial index or seed.
+				if (valueType == ResultsValueType::CENTROID_CODEC)
+				{
+					CentroidHistory::encode(values.data(), values.size(), stepSize, gridSize, encodedValues, textSignificantDigits);
+					writer.packEncoded(++trial, 0, 0, values.size(), encodedValues);
+				}
+				else
+					writer.pack(++trial, 0, 0, values);
+				if (!writer.write())
+					return false;
+			}
+			return true;
+		}
+
+		bool convertResultsToText(const std::string& resultsFilename, const std::string& textFilename)
+		{
+			ResultsReader reader;
+			if (!reader.open(resultsFilename))
+				return false;
+
+			std::ofstream textFile(textFilename);
+			if (!textFile.is_open())
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to open the file for writing " + textFilename + '.');
+				return false;
+			}
+
+			// Same formatting as the text files written by the experiment handler.
+			std::vector<double> values;
+			for (std::size_t record = 0; record < reader.getNumberOfRecords(); record++)
+			{
+				if (!reader.copyValues(record, values))
+					return false;
+				for (const double value : values)
+					textFile << value << " ";
+				textFile << '\n';
+			}
+			return static_cast<bool>(textFile);
+		}
+	}
+}
@@ -0,0 +1,48 @@
+#include "simulation_checkpoint.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		void SimulationCheckpoint::addComponent(const std::shared_ptr<dnf_composer::element::Element>& element, const std::string& componentName)
+		{
+			// The component vectors live in the element's map, so their addresses are stable across steps.
+			components.push_back({ element->getComponentPtr(componentName), {} });
+		}
+
+		void SimulationCheckpoint::addFieldCoupling(const std::shared_ptr<DegenerateFieldCoupling>& fieldCoupling)
+		{
+			this->fieldCoupling = fieldCoupling;
+		}
+
+		void SimulationCheckpoint::capture()
+		{
+			for (auto& component : components)
+				component.values = *component.buffer;
+			if (fieldCoupling)
+				couplingWeights = fieldCoupling->getCouplingWeights();
+			captured = true;
+		}
+
+		void SimulationCheckpoint::copyValuesFrom(const SimulationCheckpoint& other)
+		{
+			for (size_t i = 0; i < components.size(); i++)
+				components[i].values = other.components[i].values;
+			couplingWeights = other.couplingWeights;
+			captured = other.captured;
+		}
+
+		void SimulationCheckpoint::restore() const
+		{
+			for (const auto& component : components)
+				std::ranges::copy(component.values, component.buffer->begin());
+			if (fieldCoupling)
+				fieldCoupling->setCouplingWeights(couplingWeights);
+		}
+
+		bool SimulationCheckpoint::isCaptured() const
+		{
+			return captured;
+		}
+	}
+}
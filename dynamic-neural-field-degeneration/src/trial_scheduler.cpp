@@ -0,0 +1,308 @@
+#include "trial_scheduler.h"
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		TrialScheduler::TrialScheduler(const ExperimentParameters& params)
+			: params(params), numberOfWorkers(params.numberOfThreads)
+		{
+			if (numberOfWorkers <= 0)
+				numberOfWorkers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+		}
+
+		void TrialScheduler::addWorkItem(const TrialWorkItem& workItem)
+		{
+			workItems.push_back(workItem);
+		}
+
+		void TrialScheduler::run(const ResultCallback& onResult)
+		{
+			this->onResult = onResult;
+			pendingResults.assign(workItems.size(), std::nullopt);
+			nextResultToPublish = 0;
+
+			const int numberOfThreads = std::min(numberOfWorkers, std::max(1, static_cast<int>(workItems.size())));
+			queues.clear();
+			for (int w = 0; w < numberOfThreads; w++)
+				queues.push_back(std::make_unique<WorkQueue>());
+			// Round-robin distribution keeps early work items early on every worker.
+			for (int i = 0; i < static_cast<int>(workItems.size()); i++)
+				queues[i % numberOfThreads]->items.push_back(i);
+			settledStates = std::make_shared<SettledStateStore>();
+
+			std::vector<std::thread> workers;
+			for (int w = 0; w < numberOfThreads; w++)
+				workers.emplace_back(&TrialScheduler::work, this, w);
+			for (auto& worker : workers)
+				worker.join();
+		}
+
+		int TrialScheduler::getNumberOfWorkers() const
+		{
+			return numberOfWorkers;
+		}
+
+		std::uint64_t TrialScheduler::getNumberOfSimulationSteps() const
+		{
+			return numberOfSimulationSteps;
+		}
+
+		const SettlingStatistics& TrialScheduler::getSettlingStatistics() const
+		{
+			return settlingStatistics;
+		}
+
+		bool TrialScheduler::isBatched() const
+		{
+			// Lanes settle for a fixed number of steps, so adaptive settling and the threshold search run one trial at a time.
+			return params.batchSize > 1 && !params.isSettlingAdaptive && !params.isThresholdModeOn;
+		}
+
+		void TrialScheduler::work(int workerIndex)
+		{
+			DnfcomposerHandlerInducing handler(false, true);
+			handler.applyExperimentParameters(params);
+			handler.setSharedSettledStates(settledStates);
+			handler.init();
+
+			if (isBatched())
+				workBatched(workerIndex, handler);
+			else
+			{
+				int workItemIndex;
+				while (popWorkItem(workerIndex, workItemIndex))
+				{
+					const TrialWorkItem& workItem = workItems[workItemIndex];
+					publish(workItemIndex, runTrial(handler, workItem));
+				}
+			}
+
+			numberOfSimulationSteps += handler.getNumberOfSimulationSteps();
+			{
+				std::lock_guard lock(statisticsMutex);
+				settlingStatistics.add(handler.getSettlingStatistics());
+			}
+			handler.close();
+		}
+
+		void TrialScheduler::workBatched(int workerIndex, const DnfcomposerHandlerInducing& handler)
+		{
+			// Every lane runs the procedure of runTrial() (without the settled state cache); a lane whose trial
+			// has ended takes the next work item, so the batch stays full until the queues run dry.
+			BatchedSimulation batch(handler.getSimulation(), params.batchSize);
+			const auto coupling = std::dynamic_pointer_cast<DegenerateFieldCoupling>(
+				handler.getSimulation()->getElement(handler.getSimulationParameters().fieldCouplingId));
+			const int timeForFieldToSettle = handler.getSimulationParameters().timeForFieldToSettle;
+			std::vector<BatchLane> lanes(params.batchSize);
+			SettlingStatistics statistics;
+			std::uint64_t numberOfLaneSteps = 0;
+
+			int numberOfActiveLanes = 0;
+			for (int lane = 0; lane < params.batchSize; lane++)
+				if (startLaneTrial(workerIndex, handler, batch, lane, lanes[lane]))
+					numberOfActiveLanes++;
+
+			while (numberOfActiveLanes > 0)
+			{
+				batch.step();
+				numberOfLaneSteps += numberOfActiveLanes;
+
+				for (int lane = 0; lane < params.batchSize; lane++)
+				{
+					BatchLane& state = lanes[lane];
+					if (state.workItemIndex < 0 || --state.remainingSteps > 0)
+						continue;
+
+					statistics.numberOfSettles++;
+					statistics.numberOfSteps += timeForFieldToSettle;
+					statistics.maxNumberOfSteps = timeForFieldToSettle;
+					state.remainingSteps = timeForFieldToSettle;
+
+					// First settle done: the stimulus is removed and the fields settle again.
+					if (state.isExternalInputOn)
+					{
+						batch.setExternalInput(lane, {});
+						state.isExternalInputOn = false;
+						continue;
+					}
+
+					const double outputFieldCentroid = batch.getCentroid(lane, BatchedField::OUTPUT);
+					if (outputFieldCentroid >= 0)
+					{
+						state.result.outputFieldCentroidHistory.push_back(outputFieldCentroid);
+						degenerateLane(*coupling, batch, lane, state);
+						continue;
+					}
+
+					publish(state.workItemIndex, std::move(state.result));
+					if (!startLaneTrial(workerIndex, handler, batch, lane, state))
+						numberOfActiveLanes--;
+				}
+			}
+
+			numberOfSimulationSteps += numberOfLaneSteps;
+			std::lock_guard lock(statisticsMutex);
+			settlingStatistics.add(statistics);
+		}
+
+		bool TrialScheduler::startLaneTrial(int workerIndex, const DnfcomposerHandlerInducing& handler, BatchedSimulation& batch,
+			int lane, BatchLane& state)
+		{
+			if (!popWorkItem(workerIndex, state.workItemIndex))
+			{
+				state.workItemIndex = -1;
+				return false;
+			}
+
+			// Same random streams as DnfcomposerHandlerInducing::startTrial, so a lane replays the trial of a serial run.
+			const TrialWorkItem& workItem = workItems[state.workItemIndex];
+			const DegenerationParameters& degeneration = workItem.degenerationParameters;
+			const std::uint64_t seed = params.randomSeed;
+			const auto stream = [&workItem](RandomStream purpose) { return getRandomStream(workItem.trialIndex, purpose); };
+
+			state.result = TrialResult{};
+			state.result.workItem = workItem;
+			state.result.outputFieldCentroidHistory = handler.createOutputFieldCentroidHistory();
+			batch.resetLane(lane);
+			batch.setNoiseStreams(lane, seed, stream(RandomStream::PERCEPTUAL_NOISE), stream(RandomStream::OUTPUT_NOISE));
+
+			switch (degeneration.type)
+			{
+			case ElementDegeneracyType::NEURONS_DEACTIVATE:
+				if (degeneration.field == "perceptual")
+				{
+					state.degenerationOrder.setSeed(seed, stream(RandomStream::PERCEPTUAL_FIELD_ORDER));
+					state.degenerationOrder.reset(batch.getFieldSize(BatchedField::PERCEPTUAL));
+				}
+				else
+				{
+					state.degenerationOrder.setSeed(seed, stream(RandomStream::OUTPUT_FIELD_ORDER));
+					state.degenerationOrder.reset(batch.getFieldSize(BatchedField::OUTPUT));
+				}
+				break;
+			case ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+			case ElementDegeneracyType::WEIGHTS_RANDOMIZE:
+			case ElementDegeneracyType::WEIGHTS_REDUCE:
+				state.degenerationOrder.setSeed(seed, stream(RandomStream::COUPLING_ORDER));
+				state.degenerationOrder.reset(batch.getCouplingRows() * batch.getCouplingCols());
+				state.weightValues.seed(seed, stream(RandomStream::COUPLING_VALUES));
+				break;
+			default:
+				state.degenerationOrder.clear();
+				break;
+			}
+
+			const auto stimulus = handler.createExternalInput(workItem.targetInputFieldCentroid);
+			stimulus->init();
+			batch.setExternalInput(lane, *stimulus->getComponentPtr("output"));
+			state.isExternalInputOn = true;
+			state.remainingSteps = handler.getSimulationParameters().timeForFieldToSettle;
+			return true;
+		}
+
+		void TrialScheduler::degenerateLane(const DegenerateFieldCoupling& coupling, BatchedSimulation& batch, int lane, BatchLane& state) const
+		{
+			// Same victims and values as DegenerateNeuralField and DegenerateFieldCoupling::applyDegeneracy.
+			const DegenerationParameters& degeneration = state.result.workItem.degenerationParameters;
+			const int outputSize = batch.getCouplingCols();
+
+			for (int k = 0; k < degeneration.numberOfElementsToDegeneratePerIteration; k++)
+			{
+				const int index = state.degenerationOrder.next();
+				if (index < 0)
+					return;
+
+				const int row = index / outputSize;
+				const int col = index % outputSize;
+				switch (degeneration.type)
+				{
+				case ElementDegeneracyType::NEURONS_DEACTIVATE:
+					batch.deactivateNeuron(lane, degeneration.field == "perceptual" ? BatchedField::PERCEPTUAL : BatchedField::OUTPUT, index);
+					break;
+				case ElementDegeneracyType::WEIGHTS_DEACTIVATE:
+					batch.setWeight(lane, row, col, 0.0);
+					break;
+				case ElementDegeneracyType::WEIGHTS_RANDOMIZE:
+					batch.setWeight(lane, row, col, state.weightValues.uniform(coupling.getMinWeightValue(), coupling.getMaxWeightValue()));
+					break;
+				case ElementDegeneracyType::WEIGHTS_REDUCE:
+					batch.setWeight(lane, row, col, batch.getWeight(lane, row, col) * coupling.getWeightReductionFactor());
+					break;
+				default:
+					break;
+				}
+			}
+		}
+
+		bool TrialScheduler::popWorkItem(int workerIndex, int& workItemIndex)
+		{
+			{
+				WorkQueue& own = *queues[workerIndex];
+				std::lock_guard lock(own.mutex);
+				if (!own.items.empty())
+				{
+					workItemIndex = own.items.front();
+					own.items.pop_front();
+					return true;
+				}
+			}
+
+			const int numberOfQueues = static_cast<int>(queues.size());
+			for (int offset = 1; offset < numberOfQueues; offset++)
+			{
+				WorkQueue& victim = *queues[(workerIndex + offset) % numberOfQueues];
+				std::lock_guard lock(victim.mutex);
+				if (!victim.items.empty())
+				{
+					workItemIndex = victim.items.back();
+					victim.items.pop_back();
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void TrialScheduler::publish(int workItemIndex, TrialResult&& result)
+		{
+			std::lock_guard lock(resultsMutex);
+			pendingResults[workItemIndex] = std::move(result);
+			while (nextResultToPublish < pendingResults.size() && pendingResults[nextResultToPublish].has_value())
+			{
+				onResult(*pendingResults[nextResultToPublish]);
+				pendingResults[nextResultToPublish].reset();
+				nextResultToPublish++;
+			}
+		}
+
+		TrialResult TrialScheduler::runTrial(DnfcomposerHandlerInducing& handler, const TrialWorkItem& workItem) const
+		{
+			// Same procedure as ExperimentHandlerInducing, on a headless handler.
+			const DegenerationParameters& degeneration = workItem.degenerationParameters;
+			TrialResult result{};
+			result.workItem = workItem;
+			result.outputFieldCentroidHistory = handler.createOutputFieldCentroidHistory();
+
+			handler.startTrial(workItem.trialIndex);
+			handler.setNumberOfElementsToDegenerate(degeneration.numberOfElementsToDegeneratePerIteration);
+			handler.setExternalInput(workItem.targetInputFieldCentroid);
+
+			if (params.isThresholdModeOn)
+			{
+				result.threshold = handler.findDegenerationThreshold(degeneration.type, degeneration.field,
+					workItem.targetOutputFieldCentroid, params.decisionTolerance);
+			}
+			else
+			{
+				while (handler.getOutputFieldCentroid() >= 0)
+				{
+					result.outputFieldCentroidHistory.push_back(handler.getOutputFieldCentroid());
+					handler.setDegeneracy(degeneration.type, degeneration.field);
+				}
+			}
+
+			handler.closeSimulation();
+			return result;
+		}
+	}
+}
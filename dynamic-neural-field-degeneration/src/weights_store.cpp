@@ -0,0 +1,256 @@
+#include "weights_store.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <tools/logger.h>
+
+namespace experiment
+{
+	namespace degeneration
+	{
+		namespace
+		{
+			constexpr char weightsMagic[8] = { 'D', 'N', 'F', 'W', 'G', 'H', 'T', 'S' };
+			constexpr std::uint32_t weightsVersion = 2;
+			constexpr std::uint64_t fnvPrime = 0x100000001b3ull;
+
+			std::uint64_t getWeightsChecksum(const WeightsFileHeader& header, const unsigned char* rows)
+			{
+				return getChecksum(rows, static_cast<std::size_t>(header.rows) * header.stride * sizeof(double));
+			}
+
+			// Size and last write time of a file, false if it does not exist.
+			bool getFileStamp(const std::string& filename, std::uint64_t& size, std::int64_t& writeTime)
+			{
+				std::error_code error;
+				size = std::filesystem::file_size(filename, error);
+				if (error)
+					return false;
+				writeTime = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+				return !error;
+			}
+		}
+
+		std::uint64_t getChecksum(const void* data, std::size_t size, std::uint64_t checksum)
+		{
+			const auto* bytes = static_cast<const unsigned char*>(data);
+			std::size_t offset = 0;
+			for (; offset + sizeof(std::uint64_t) <= size; offset += sizeof(std::uint64_t))
+			{
+				std::uint64_t word;
+				std::memcpy(&word, bytes + offset, sizeof(word));
+				checksum = (checksum ^ word) * fnvPrime;
+			}
+			if (offset < size)
+			{
+				std::uint64_t word = 0;
+				std::memcpy(&word, bytes + offset, size - offset);
+				checksum = (checksum ^ word) * fnvPrime;
+			}
+			return checksum;
+		}
+
+		bool MappedWeights::open(const std::string& filename, int rows, int cols, std::uint64_t trainingChecksum, const std::string& sourceFilename)
+		{
+			if (!std::filesystem::exists(filename) || !file.open(filename))
+				return false;
+
+			std::string problem;
+			if (file.getSize() < sizeof(WeightsFileHeader))
+				problem = "is not a weight file";
+			else
+			{
+				std::memcpy(&header, file.getData(), sizeof(header));
+				const std::size_t expectedSize = sizeof(WeightsFileHeader) + static_cast<std::size_t>(header.rows) * header.stride * sizeof(double);
+				if (std::memcmp(header.magic, weightsMagic, sizeof(weightsMagic)) != 0 || header.version != weightsVersion
+					|| header.valueSize != sizeof(double) || header.stride < header.cols
+					|| header.stride % CouplingWeights::rowAlignmentInElements != 0)
+					problem = "is not a weight file";
+				else if (header.rows != static_cast<std::uint32_t>(rows) || header.cols != static_cast<std::uint32_t>(cols))
+					problem = "holds " + std::to_string(header.rows) + " x " + std::to_string(header.cols) + " weights, not "
+						+ std::to_string(rows) + " x " + std::to_string(cols);
+				else if (header.trainingChecksum != trainingChecksum)
+					problem = "was trained for other coupling parameters";
+				else if (file.getSize() != expectedSize || getWeightsChecksum(header, file.getData() + sizeof(WeightsFileHeader)) != header.weightsChecksum)
+					problem = "is corrupted (checksum mismatch)";
+				else
+				{
+					// Without the text weights (a binary-only copy of the data) there is nothing to compare against.
+					std::uint64_t sourceSize;
+					std::int64_t sourceWriteTime;
+					if (getFileStamp(sourceFilename, sourceSize, sourceWriteTime)
+						&& (sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime))
+						problem = "was not converted from the current " + sourceFilename;
+				}
+			}
+
+			if (!problem.empty())
+			{
+				file.close();
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, filename + ' ' + problem + ", using the text weights.");
+				return false;
+			}
+			return true;
+		}
+
+		const WeightsFileHeader& MappedWeights::getHeader() const
+		{
+			return header;
+		}
+
+		const double* MappedWeights::row(int row) const
+		{
+			// The mapping is page aligned and the header is two cache lines long.
+			return reinterpret_cast<const double*>(file.getData() + sizeof(WeightsFileHeader)) + static_cast<std::size_t>(row) * header.stride;
+		}
+
+		void MappedWeights::copyTo(CouplingWeights& weights) const
+		{
+			const int rows = static_cast<int>(header.rows);
+			const int cols = static_cast<int>(header.cols);
+			if (weights.getRows() != rows || weights.getCols() != cols)
+				weights.resize(rows, cols);
+			for (int i = 0; i < rows; i++)
+				std::memcpy(weights.row(i), row(i), static_cast<std::size_t>(cols) * sizeof(double));
+		}
+
+		std::shared_ptr<const MappedWeights> mapWeightsFile(const std::string& filename, int rows, int cols, std::uint64_t trainingChecksum,
+			const std::string& sourceFilename)
+		{
+			// Expired entries are mapped again, so a file converted while the process runs is picked up.
+			static std::mutex mutex;
+			static std::map<std::tuple<std::string, int, int, std::uint64_t, std::string>, std::weak_ptr<const MappedWeights>> mappings;
+
+			std::lock_guard lock(mutex);
+			std::weak_ptr<const MappedWeights>& mapping = mappings[{ filename, rows, cols, trainingChecksum, sourceFilename }];
+			if (auto weights = mapping.lock())
+				return weights;
+
+			auto weights = std::make_shared<MappedWeights>();
+			if (!weights->open(filename, rows, cols, trainingChecksum, sourceFilename))
+				return nullptr;
+			mapping = weights;
+			return weights;
+		}
+
+		std::shared_ptr<const CouplingWeights> viewMappedWeights(std::shared_ptr<const MappedWeights> mappedWeights)
+		{
+			const WeightsFileHeader& header = mappedWeights->getHeader();
+			const double* rows = mappedWeights->row(0);
+			return std::make_shared<const CouplingWeights>(CouplingWeights::view(rows, static_cast<int>(header.rows),
+				static_cast<int>(header.cols), static_cast<int>(header.stride), std::move(mappedWeights)));
+		}
+
+		std::shared_ptr<const CouplingWeights> shareCouplingWeights(CouplingWeights&& weights)
+		{
+			static std::mutex mutex;
+			static std::map<std::tuple<int, int, std::uint64_t>, std::weak_ptr<const CouplingWeights>> sharedWeights;
+
+			const std::size_t size = static_cast<std::size_t>(weights.getRows()) * weights.getStride() * sizeof(double);
+			const std::uint64_t checksum = getChecksum(weights.data(), size);
+
+			std::lock_guard lock(mutex);
+			std::weak_ptr<const CouplingWeights>& entry = sharedWeights[{ weights.getRows(), weights.getCols(), checksum }];
+			auto shared = entry.lock();
+			if (shared && std::memcmp(shared->data(), weights.data(), size) == 0)
+				return shared;
+
+			shared = std::make_shared<const CouplingWeights>(std::move(weights));
+			entry = shared;
+			return shared;
+		}
+
+		bool writeWeightsFile(const std::string& filename, const CouplingWeights& weights, std::uint64_t trainingChecksum, const std::string& name,
+			const std::string& sourceFilename)
+		{
+			WeightsFileHeader header{};
+			std::memcpy(header.magic, weightsMagic, sizeof(weightsMagic));
+			header.version = weightsVersion;
+			header.valueSize = sizeof(double);
+			header.rows = static_cast<std::uint32_t>(weights.getRows());
+			header.cols = static_cast<std::uint32_t>(weights.getCols());
+			header.stride = static_cast<std::uint32_t>(weights.getStride());
+			header.trainingChecksum = trainingChecksum;
+			header.weightsChecksum = getWeightsChecksum(header, reinterpret_cast<const unsigned char*>(weights.data()));
+			std::strncpy(header.name, name.c_str(), sizeof(header.name) - 1);
+			if (!getFileStamp(sourceFilename, header.sourceSize, header.sourceWriteTime))
+			{
+				header.sourceSize = 0;
+				header.sourceWriteTime = 0;
+			}
+
+			// Written next to the target and renamed over it, so a running experiment never maps half a file. The
+			// temporary name is per thread: the couplings of parallel simulations may rewrite a stale file together.
+			const std::string temporaryFilename = filename + '.' + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+			{
+				std::ofstream file(temporaryFilename, std::ios::binary | std::ios::trunc);
+				file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+				file.write(reinterpret_cast<const char*>(weights.data()), static_cast<std::streamsize>(static_cast<std::size_t>(header.rows) * header.stride * sizeof(double)));
+				if (!file)
+				{
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to write the weight file " + temporaryFilename + '.');
+					return false;
+				}
+			}
+
+			std::error_code error;
+			std::filesystem::rename(temporaryFilename, filename, error);
+			if (error)
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to replace " + filename + ": " + error.message() + '.');
+				return false;
+			}
+			return true;
+		}
+
+		bool readTextWeights(const std::string& filename, CouplingWeights& weights)
+		{
+			std::ifstream textFile(filename);
+			if (!textFile.is_open())
+			{
+				dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Failed to open the weight file " + filename + '.');
+				return false;
+			}
+
+			std::vector<std::vector<double>> rows;
+			std::string line;
+			while (std::getline(textFile, line))
+			{
+				std::vector<double> row;
+				const char* cursor = line.c_str();
+				char* end = nullptr;
+				for (double value = std::strtod(cursor, &end); end != cursor; value = std::strtod(cursor, &end))
+				{
+					row.push_back(value);
+					cursor = end;
+				}
+				if (row.empty())
+					continue;
+				if (!rows.empty() && row.size() != rows.front().size())
+				{
+					dnf_composer::tools::logger::log(dnf_composer::tools::logger::ERROR, "Row " + std::to_string(rows.size() + 1) + " of " + filename
+						+ " has " + std::to_string(row.size()) + " weights, expected " + std::to_string(rows.front().size()) + '.');
+					return false;
+				}
+				rows.push_back(std::move(row));
+			}
+			weights.assign(rows);
+			return !rows.empty();
+		}
+
+		bool convertTextToWeights(const std::string& textFilename, const std::string& weightsFilename, std::uint64_t trainingChecksum,
+			const std::string& name)
+		{
+			CouplingWeights weights;
+			return readTextWeights(textFilename, weights) && writeWeightsFile(weightsFilename, weights, trainingChecksum, name, textFilename);
+		}
+	}
+}